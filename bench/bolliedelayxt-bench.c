@@ -0,0 +1,999 @@
+/**
+    Bollie Delay XT - (c) 2017 Thomas Ebeling https://ca9.eu
+
+    This file is part of bolliedelayxt.lv2
+
+    bolliedelay.lv2 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    bolliedelay.lv2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+* \file bolliedelayxt-bench.c
+* \author Bollie
+* \brief Headless benchmark, driving the plugin through its descriptor.
+*
+* Usage: bolliedelayxt-bench [-r rate] [-b block size] [-c scenario]
+*        [-s seconds] [-v variant] [-R dir | -C dir] [-i | -x] [-p] [-w]
+*
+* Without options all sample rates, block sizes from 16 to 4096 and all
+* scenarios are measured. -v picks the plugin variant by its descriptor
+* index: 0 stereo (default), 1 mono, 2 quad, 3 5.1. Even channels get the
+* first input signal, odd ones the second.
+*
+* With -R the render cases are written to dir as raw interleaved floats. With
+* -C they are rendered again and compared against the files in dir, reporting
+* max-abs and RMS error per case, failing if either exceeds the tolerance of
+* the case. make test compares against the references in test/ref. -i
+* renders with the outputs connected to the input buffers, -x with the
+* channels crossed over, so in-place processing can be checked against a
+* regular reference.
+*
+* -p switches on CP_PROFILE and prints the average load of each stage, as
+* read from the output ports, below each result. That needs a build with
+* PROFILE=true.
+*
+* The plugin gets a host worker, that handles its requests right after
+* each run, outside the measured time. -w leaves it out.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#include "lv2/lv2plug.in/ns/lv2core/lv2.h"
+#include "lv2/lv2plug.in/ns/ext/atom/atom.h"
+#include "lv2/lv2plug.in/ns/ext/patch/patch.h"
+#include "lv2/lv2plug.in/ns/ext/state/state.h"
+#include "lv2/lv2plug.in/ns/ext/time/time.h"
+#include "lv2/lv2plug.in/ns/ext/urid/urid.h"
+#include "lv2/lv2plug.in/ns/ext/worker/worker.h"
+
+#define MAX_BLOCK 4096
+#define MAX_CHANNELS 6
+#define MAX_PORTS 118
+#define MAX_URIS 256
+#define MAX_STATE 16
+#define WARMUP_S 1.0
+#define TAIL_LEVEL 1e-34f
+#define RENDER_S 4.0
+#define RENDER_BLOCK 333
+#define CONTROL_PORT 35
+#define TAP_PORTS 36       ///< first tap port, 4 per tap, 8 taps per channel
+#define TAP(c, t, k) (TAP_PORTS + (((c) - 1) * 8 + (t) - 1) * 4 + (k))
+#define LIM_LINK 100
+#define LIM_LOOKAHEAD 101
+#define DELAY_JUMP 102
+#define PROFILE 103
+#define PROFILE_OUT 104    ///< average and maximum of each stage, then load
+#define PLUGIN_URI "https://ca9.eu/lv2/bolliedelayxt"
+
+/**
+* Number of channels of each variant, by descriptor index
+*/
+static const uint32_t variant_channels[] = { 2, 1, 4, 6 };
+#define N_VARIANTS (sizeof(variant_channels) / sizeof(variant_channels[0]))
+
+/**
+* Default values of the control ports, indexed like the ports in the TTL of
+* the stereo variant
+*/
+static const float port_defaults[MAX_PORTS] = {
+    [4] = 1,        // CP_ENABLED
+    [5] = 0,        // CP_TRAILS
+    [6] = 1,        // CP_TEMPO_MODE, user tempo
+    [7] = 0,        // CP_PING_PONG
+    [8] = 120,      // CP_TEMPO_HOST
+    [9] = 120,      // CP_TEMPO_USER
+    [10] = 0,       // CP_TEMPO_DIV_CH1
+    [11] = 3,       // CP_TEMPO_DIV_CH2
+    [12] = 50,      // CP_FB
+    [13] = 5,       // CP_CF
+    [14] = 0,       // CP_GAIN_DRY
+    [15] = -12,     // CP_GAIN_WET
+    [16] = 0,       // CP_MOD_ON
+    [17] = 0,       // CP_MOD_PHASE
+    [18] = 2,       // CP_MOD_DEPTH
+    [19] = 0.1,     // CP_MOD_RATE
+    [20] = 0,       // CP_HCF_PRE_ON
+    [21] = 7500,    // CP_HCF_PRE_FREQ
+    [22] = 1,       // CP_HCF_PRE_Q
+    [23] = 0,       // CP_LCF_PRE_ON
+    [24] = 20,      // CP_LCF_PRE_FREQ
+    [25] = 1,       // CP_LCF_PRE_Q
+    [26] = 0,       // CP_HCF_FB_ON
+    [27] = 7500,    // CP_HCF_FB_FREQ
+    [28] = 1,       // CP_HCF_FB_Q
+    [29] = 0,       // CP_LCF_FB_ON
+    [30] = 20,      // CP_LCF_FB_FREQ
+    [31] = 1,       // CP_LCF_FB_Q
+    [32] = 0,       // CP_TEMPO_OUT
+    [33] = 0,       // CP_INTERP
+    [34] = 0,       // CP_MOD_SHAPE
+    [LIM_LINK] = 0,
+    [LIM_LOOKAHEAD] = 0,
+    [DELAY_JUMP] = 0,
+    [PROFILE] = 0,
+};
+
+
+/**
+* Fills in the default port values. The taps are silent, each one on its
+* own division and panned to the side of its channel.
+*/
+static void default_ports(float* ports) {
+    memcpy(ports, port_defaults, sizeof(port_defaults));
+    for (int c = 1 ; c <= 2 ; ++c) {
+        for (int t = 1 ; t <= 8 ; ++t) {
+            ports[TAP(c, t, 0)] = (t - 1) % 6;
+            ports[TAP(c, t, 1)] = -97;
+            ports[TAP(c, t, 2)] = c == 1 ? -100 : 100;
+            ports[TAP(c, t, 3)] = 0;
+        }
+    }
+}
+
+/**
+* A benchmark scenario: a name and a list of port settings
+*/
+typedef struct {
+    const char* name;
+    struct { int port; float value; } set[18];
+    int tail;       ///< input goes silent after the warm up, 2: and warm
+                    ///< up at a very low level
+} Scenario;
+
+static const Scenario scenarios[] = {
+    { "plain",       { { -1, 0 } }, 0 },
+    { "ping-pong",   { { 7, 1 }, { -1, 0 } }, 0 },
+    { "mod",         { { 16, 1 }, { -1, 0 } }, 0 },
+    { "mod-cubic",   { { 16, 1 }, { 33, 1 }, { -1, 0 } }, 0 },
+    { "hcf-pre",     { { 20, 1 }, { -1, 0 } }, 0 },
+    { "lcf-pre",     { { 23, 1 }, { -1, 0 } }, 0 },
+    { "hcf-fb",      { { 26, 1 }, { -1, 0 } }, 0 },
+    { "lcf-fb",      { { 29, 1 }, { -1, 0 } }, 0 },
+    { "all-filters", { { 20, 1 }, { 23, 1 }, { 26, 1 }, { 29, 1 },
+                       { -1, 0 } }, 0 },
+    { "full",        { { 7, 1 }, { 16, 1 }, { 20, 1 }, { 23, 1 }, { 26, 1 },
+                       { 29, 1 }, { -1, 0 } }, 0 },
+    { "trails",      { { 4, 0 }, { 5, 1 }, { -1, 0 } }, 0 },
+    { "bypass",      { { 4, 0 }, { -1, 0 } }, 0 },
+    { "idle",        { { 12, 0 }, { 13, 0 }, { -1, 0 } }, 1 },
+    { "taps-8",      { { TAP(1, 1, 1), -12 }, { TAP(1, 2, 1), -12 },
+                       { TAP(1, 3, 1), -12 }, { TAP(1, 4, 1), -12 },
+                       { TAP(1, 5, 1), -12 }, { TAP(1, 6, 1), -12 },
+                       { TAP(1, 7, 1), -12 }, { TAP(1, 8, 1), -12 },
+                       { -1, 0 } }, 0 },
+    { "taps-16",     { { TAP(1, 1, 1), -12 }, { TAP(1, 2, 1), -12 },
+                       { TAP(1, 3, 1), -12 }, { TAP(1, 4, 1), -12 },
+                       { TAP(1, 5, 1), -12 }, { TAP(1, 6, 1), -12 },
+                       { TAP(1, 7, 1), -12 }, { TAP(1, 8, 1), -12 },
+                       { TAP(2, 1, 1), -12 }, { TAP(2, 2, 1), -12 },
+                       { TAP(2, 3, 1), -12 }, { TAP(2, 4, 1), -12 },
+                       { TAP(2, 5, 1), -12 }, { TAP(2, 6, 1), -12 },
+                       { TAP(2, 7, 1), -12 }, { TAP(2, 8, 1), -12 },
+                       { -1, 0 } }, 0 },
+    /* Modulated feedback and crossfeed above unity, the limiter holds the
+       lines at full scale */
+    { "runaway",     { { 12, 100 }, { 13, 50 }, { 16, 1 }, { 18, 5 },
+                       { -1, 0 } }, 0 },
+    { "runaway-la",  { { 12, 100 }, { 13, 50 }, { 16, 1 }, { 18, 5 },
+                       { LIM_LINK, 1 }, { LIM_LOOKAHEAD, 1 }, { -1, 0 } }, 0 },
+    { "jump",        { { DELAY_JUMP, 1 }, { -1, 0 } }, 0 },
+    /* Short delays, high feedback and all filters, decaying from a very low
+       level after the warm up. States and delay lines run down into the
+       denormal range right away. */
+    { "tail",        { { 9, 600 }, { 10, 5 }, { 11, 5 }, { 12, 90 }, { 20, 1 },
+                       { 23, 1 }, { 26, 1 }, { 29, 1 }, { -1, 0 } }, 2 },
+};
+
+#define N_SCENARIOS (sizeof(scenarios) / sizeof(scenarios[0]))
+
+static const double rates[] = { 44100, 48000, 96000 };
+
+#define N_RATES (sizeof(rates) / sizeof(rates[0]))
+
+static int in_place = 0;    ///< 1: outputs share the inputs, 2: crossed over
+static int profile = 0;     ///< print the load output ports
+static int no_worker = 0;   ///< don't offer the host worker
+
+/**
+* Event buffer for the control port
+*/
+typedef struct {
+    LV2_Atom_Sequence seq;
+    uint8_t events[1024];
+} ControlBuffer;
+
+static char* uris[MAX_URIS];
+static uint32_t n_uris = 0;
+
+
+/**
+* Trivial URID map for the features passed to the plugin
+*/
+static LV2_URID map_uri(LV2_URID_Map_Handle handle, const char* uri) {
+    for (uint32_t i = 0 ; i < n_uris ; ++i) {
+        if (!strcmp(uris[i], uri))
+            return i + 1;
+    }
+    if (n_uris == MAX_URIS)
+        return 0;
+    uris[n_uris] = strdup(uri);
+    return ++n_uris;
+}
+
+
+/**
+* Requests to the host worker or its replies, queued until the next run
+*/
+typedef struct {
+    uint32_t n;
+    struct { uint32_t size; uint8_t data[64]; } items[8];
+} WorkQueue;
+
+static WorkQueue work_requests, work_replies;
+
+
+/**
+* Queues a request or reply for the host worker.
+*/
+static LV2_Worker_Status work_queue(WorkQueue* q, uint32_t size,
+    const void* data) {
+    if (q->n == 8 || size > sizeof(q->items[0].data))
+        return LV2_WORKER_ERR_NO_SPACE;
+    q->items[q->n].size = size;
+    memcpy(q->items[q->n].data, data, size);
+    ++q->n;
+    return LV2_WORKER_SUCCESS;
+}
+
+
+/**
+* schedule_work() of the host worker, called by the plugin during run().
+*/
+static LV2_Worker_Status schedule_work(LV2_Worker_Schedule_Handle handle,
+    uint32_t size, const void* data) {
+    return work_queue(&work_requests, size, data);
+}
+
+
+/**
+* Lets the plugin reply from its work.
+*/
+static LV2_Worker_Status work_respond(LV2_Worker_Respond_Handle handle,
+    uint32_t size, const void* data) {
+    return work_queue(&work_replies, size, data);
+}
+
+
+/**
+* Does the work requested during the last run and hands the replies to the
+* plugin, as if the worker thread got done before the next run.
+*/
+static void run_worker(const LV2_Descriptor* desc, LV2_Handle h) {
+    const LV2_Worker_Interface* wi = (const LV2_Worker_Interface*)
+        desc->extension_data(LV2_WORKER__interface);
+    for (uint32_t i = 0 ; wi && i < work_requests.n ; ++i)
+        wi->work(h, work_respond, NULL, work_requests.items[i].size,
+            work_requests.items[i].data);
+    for (uint32_t i = 0 ; wi && i < work_replies.n ; ++i)
+        wi->work_response(h, work_replies.items[i].size,
+            work_replies.items[i].data);
+    work_requests.n = work_replies.n = 0;
+}
+
+
+/**
+* Empties the control port buffer, as the host does before every run.
+*/
+static void seq_clear(ControlBuffer* cb) {
+    cb->seq.atom.type = map_uri(NULL, LV2_ATOM__Sequence);
+    cb->seq.atom.size = sizeof(LV2_Atom_Sequence_Body);
+    cb->seq.body.unit = 0;
+    cb->seq.body.pad = 0;
+}
+
+
+/**
+* Appends a patch:Set message for a parameter to the control port buffer.
+*/
+static void seq_patch_set(ControlBuffer* cb, int64_t frames,
+    const char* symbol, float value) {
+    struct {
+        LV2_Atom_Event ev;
+        LV2_Atom_Object_Body obj;
+        LV2_Atom_Property_Body prop_key;
+        uint32_t prop_urid;
+        uint32_t pad0;
+        LV2_Atom_Property_Body value_key;
+        float value;
+        uint32_t pad1;
+    } msg;
+    char uri[256];
+
+    if (cb->seq.atom.size + sizeof(msg) > sizeof(LV2_Atom_Sequence_Body)
+        + sizeof(cb->events))
+        return;
+
+    snprintf(uri, sizeof(uri), "%s#%s", PLUGIN_URI, symbol);
+    memset(&msg, 0, sizeof(msg));
+    msg.ev.time.frames = frames;
+    msg.ev.body.type = map_uri(NULL, LV2_ATOM__Object);
+    msg.ev.body.size = sizeof(msg) - sizeof(LV2_Atom_Event);
+    msg.obj.otype = map_uri(NULL, LV2_PATCH__Set);
+    msg.prop_key.key = map_uri(NULL, LV2_PATCH__property);
+    msg.prop_key.value.type = map_uri(NULL, LV2_ATOM__URID);
+    msg.prop_key.value.size = sizeof(uint32_t);
+    msg.prop_urid = map_uri(NULL, uri);
+    msg.value_key.key = map_uri(NULL, LV2_PATCH__value);
+    msg.value_key.value.type = map_uri(NULL, LV2_ATOM__Float);
+    msg.value_key.value.size = sizeof(float);
+    msg.value = value;
+
+    memcpy((uint8_t*)&cb->seq.body + cb->seq.atom.size, &msg, sizeof(msg));
+    cb->seq.atom.size += sizeof(msg);
+}
+
+
+/**
+* Appends a rolling time:Position to the control port buffer.
+*/
+static void seq_position(ControlBuffer* cb, int64_t frames, float bpm,
+    float bar_beat) {
+    struct {
+        LV2_Atom_Event ev;
+        LV2_Atom_Object_Body obj;
+        LV2_Atom_Property_Body bpm_key;
+        float bpm;
+        uint32_t pad0;
+        LV2_Atom_Property_Body beat_key;
+        float beat;
+        uint32_t pad1;
+        LV2_Atom_Property_Body speed_key;
+        float speed;
+        uint32_t pad2;
+    } msg;
+
+    if (cb->seq.atom.size + sizeof(msg) > sizeof(LV2_Atom_Sequence_Body)
+        + sizeof(cb->events))
+        return;
+
+    LV2_URID atom_float = map_uri(NULL, LV2_ATOM__Float);
+    memset(&msg, 0, sizeof(msg));
+    msg.ev.time.frames = frames;
+    msg.ev.body.type = map_uri(NULL, LV2_ATOM__Object);
+    msg.ev.body.size = sizeof(msg) - sizeof(LV2_Atom_Event);
+    msg.obj.otype = map_uri(NULL, LV2_TIME__Position);
+    msg.bpm_key.key = map_uri(NULL, LV2_TIME__beatsPerMinute);
+    msg.bpm_key.value.type = atom_float;
+    msg.bpm_key.value.size = sizeof(float);
+    msg.bpm = bpm;
+    msg.beat_key.key = map_uri(NULL, LV2_TIME__barBeat);
+    msg.beat_key.value.type = atom_float;
+    msg.beat_key.value.size = sizeof(float);
+    msg.beat = bar_beat;
+    msg.speed_key.key = map_uri(NULL, LV2_TIME__speed);
+    msg.speed_key.value.type = atom_float;
+    msg.speed_key.value.size = sizeof(float);
+    msg.speed = 1;
+
+    memcpy((uint8_t*)&cb->seq.body + cb->seq.atom.size, &msg, sizeof(msg));
+    cb->seq.atom.size += sizeof(msg);
+}
+
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+
+static int cmp_double(const void* a, const void* b) {
+    double d = *(const double*)a - *(const double*)b;
+    return d < 0 ? -1 : d > 0;
+}
+
+
+/**
+* Fills a block with noise bursts, so the delay lines always carry signal
+*/
+static void fill_input(float* ch1, float* ch2, uint32_t n, uint64_t* pos,
+    double rate, uint32_t* seed) {
+    for (uint32_t i = 0 ; i < n ; ++i, ++*pos) {
+        *seed = *seed * 1664525u + 1013904223u;
+        float v = ((*seed >> 8) / 8388608.f - 1.f) * 0.25f;
+        int on = (*pos % (uint64_t)rate) < rate / 4;
+        ch1[i] = on ? v : 0;
+        ch2[i] = on ? -v : 0;
+    }
+}
+
+
+/**
+* Runs one scenario and prints a line of results. The control ports follow
+* the audio ports of all channels, so they are shifted from their stereo
+* index for the other variants.
+*/
+static int bench(const LV2_Descriptor* desc, const LV2_Feature* const* features,
+    uint32_t channels, const Scenario* sc, double rate, uint32_t block,
+    double seconds) {
+
+    static float in_ch1[MAX_BLOCK], in_ch2[MAX_BLOCK];
+    static float out[MAX_CHANNELS][MAX_BLOCK];
+    static ControlBuffer control;
+    float ports[MAX_PORTS];
+    uint32_t shift = 2 * channels - 4;
+
+    LV2_Handle h = desc->instantiate(desc, rate, ".", features);
+    if (!h) {
+        fprintf(stderr, "instantiate failed at %.0f Hz\n", rate);
+        return 1;
+    }
+
+    default_ports(ports);
+    for (int i = 0 ; sc->set[i].port >= 0 ; ++i)
+        ports[sc->set[i].port] = sc->set[i].value;
+    ports[PROFILE] = profile;
+
+    for (uint32_t c = 0 ; c < channels ; ++c) {
+        desc->connect_port(h, c, c & 1 ? in_ch2 : in_ch1);
+        desc->connect_port(h, channels + c, out[c]);
+    }
+    for (uint32_t p = 4 ; p < MAX_PORTS ; ++p) {
+        if (p != CONTROL_PORT)
+            desc->connect_port(h, p + shift, &ports[p]);
+    }
+    desc->connect_port(h, CONTROL_PORT + shift, &control);
+    seq_clear(&control);
+
+    desc->activate(h);
+
+    uint64_t pos = 0;
+    uint32_t seed = 1;
+
+    // Warm up, so the delay is cycling and all smoothers have settled
+    uint32_t n_warmup = WARMUP_S * rate / block + 1;
+    for (uint32_t b = 0 ; b < n_warmup ; ++b) {
+        fill_input(in_ch1, in_ch2, block, &pos, rate, &seed);
+        for (uint32_t i = 0 ; sc->tail == 2 && i < block ; ++i) {
+            in_ch1[i] *= TAIL_LEVEL;
+            in_ch2[i] *= TAIL_LEVEL;
+        }
+        desc->run(h, block);
+        run_worker(desc, h);
+    }
+
+    uint32_t n_blocks = seconds * rate / block + 1;
+    double* times = (double*)malloc(n_blocks * sizeof(double));
+    double total = 0;
+    if (sc->tail) {
+        memset(in_ch1, 0, sizeof(in_ch1));
+        memset(in_ch2, 0, sizeof(in_ch2));
+    }
+    for (uint32_t b = 0 ; b < n_blocks ; ++b) {
+        if (!sc->tail)
+            fill_input(in_ch1, in_ch2, block, &pos, rate, &seed);
+        double t0 = now_ns();
+        desc->run(h, block);
+        times[b] = now_ns() - t0;
+        total += times[b];
+        run_worker(desc, h);
+    }
+
+    desc->deactivate(h);
+    desc->cleanup(h);
+
+    qsort(times, n_blocks, sizeof(double), cmp_double);
+    double samples = (double)n_blocks * block;
+    printf("%-12s %2u %6.0f %5u %9.2f %9.1f %9.2f %9.2f %9.2f\n",
+        sc->name, channels, rate, block,
+        total / samples,
+        samples / rate * 1e9 / total,
+        times[n_blocks / 2] / 1000,
+        times[(uint32_t)(n_blocks * 0.99)] / 1000,
+        times[n_blocks - 1] / 1000);
+    if (profile) {
+        const float* p = ports + PROFILE_OUT;
+        printf("  %% smooth %.2f reads %.2f limiter %.2f fb %.2f pre %.2f "
+            "mix %.2f load %.2f peak %.2f\n", p[0], p[2], p[4], p[6], p[8],
+            p[10], p[12], p[13]);
+    }
+
+    free(times);
+    return 0;
+}
+
+/**
+* In memory store of a saved plugin state
+*/
+typedef struct {
+    uint32_t n;
+    struct { uint32_t key, type, size; uint8_t value[16]; } items[MAX_STATE];
+} StateStore;
+
+
+static LV2_State_Status state_store(LV2_State_Handle handle, uint32_t key,
+    const void* value, size_t size, uint32_t type, uint32_t flags) {
+    StateStore* st = (StateStore*)handle;
+    if (st->n == MAX_STATE || size > sizeof(st->items[0].value))
+        return LV2_STATE_ERR_UNKNOWN;
+    st->items[st->n].key = key;
+    st->items[st->n].type = type;
+    st->items[st->n].size = size;
+    memcpy(st->items[st->n].value, value, size);
+    ++st->n;
+    return LV2_STATE_SUCCESS;
+}
+
+
+static const void* state_retrieve(LV2_State_Handle handle, uint32_t key,
+    size_t* size, uint32_t* type, uint32_t* flags) {
+    StateStore* st = (StateStore*)handle;
+    for (uint32_t i = 0 ; i < st->n ; ++i) {
+        if (st->items[i].key == key) {
+            *size = st->items[i].size;
+            *type = st->items[i].type;
+            *flags = LV2_STATE_IS_POD | LV2_STATE_IS_PORTABLE;
+            return st->items[i].value;
+        }
+    }
+    return NULL;
+}
+
+
+/**
+* Input signals of the render cases
+*/
+typedef enum {
+    SIG_IMPULSE,    ///< one impulse per second, ch2 half a second later
+    SIG_SWEEP,      ///< logarithmic sine sweep from 20 Hz to 20 kHz
+    SIG_NOISE,      ///< white noise
+    SIG_GATED       ///< silence, one second of noise, silence
+} Signal;
+
+/**
+* A render case: input signal, port settings, a script of port changes and
+* the tolerated max-abs and RMS deviation from the reference. Script
+* entries with a parameter symbol are sent as patch:Set on the control port
+* instead, those with "time:Position" as a rolling transport at the given
+* tempo.
+* "state:restore" saves the state, replaces the instance by a fresh one and
+* restores the state into that, like a host reloading a session.
+*/
+typedef struct {
+    const char* name;
+    Signal signal;
+    struct { int port; float value; } set[8];
+    struct { float t; int port; float value; const char* patch; } script[4];
+    float tolerance;
+    float rms_tolerance;
+} RenderCase;
+
+/* The tolerances leave room for other compilers and FMA contraction. These
+   change single samples the most around impulses read at gliding delay
+   times and in the filtered sweep, so max-abs is set from those, RMS
+   catches changes spread over the whole render. */
+static const RenderCase render_cases[] = {
+    { "impulse", SIG_IMPULSE, { { -1, 0 } }, { { 0, -1, 0, NULL } },
+        1e-5, 1e-6 },
+    { "impulse-pingpong", SIG_IMPULSE, { { 7, 1 }, { -1, 0 } },
+        { { 0, -1, 0, NULL } }, 1e-5, 1e-6 },
+    { "impulse-fb-filters", SIG_IMPULSE,
+        { { 12, 100 }, { 26, 1 }, { 29, 1 }, { -1, 0 } },
+        { { 0, -1, 0, NULL } }, 1e-4, 1e-5 },
+    { "impulse-tempo", SIG_IMPULSE, { { -1, 0 } },
+        { { 1.5, 9, 90, NULL }, { 0, -1, 0, NULL } }, 1e-5, 1e-6 },
+    { "impulse-jump", SIG_IMPULSE, { { DELAY_JUMP, 1 }, { -1, 0 } },
+        { { 1.5, 9, 90, NULL }, { 2.2, 10, 2, NULL }, { 0, -1, 0, NULL } },
+        1e-5, 1e-6 },
+    { "sweep-filters", SIG_SWEEP,
+        { { 20, 1 }, { 23, 1 }, { 26, 1 }, { 29, 1 }, { -1, 0 } },
+        { { 0, -1, 0, NULL } }, 5e-3, 1e-3 },
+    { "noise-mod", SIG_NOISE, { { 16, 1 }, { -1, 0 } },
+        { { 0, -1, 0, NULL } }, 1e-4, 1e-5 },
+    { "noise-mod-lagrange", SIG_NOISE, { { 16, 1 }, { 33, 2 }, { -1, 0 } },
+        { { 0, -1, 0, NULL } }, 1e-3, 5e-5 },
+    { "noise-full", SIG_NOISE,
+        { { 7, 1 }, { 16, 1 }, { 20, 1 }, { 23, 1 }, { 26, 1 }, { 29, 1 },
+          { -1, 0 } },
+        { { 0, -1, 0, NULL } }, 1e-4, 1e-5 },
+    { "gated", SIG_GATED, { { -1, 0 } }, { { 0, -1, 0, NULL } },
+        1e-5, 1e-6 },
+    { "fade-out-in", SIG_NOISE, { { -1, 0 } },
+        { { 1.0, 4, 0, NULL }, { 2.0, 4, 1, NULL }, { 0, -1, 0, NULL } },
+        1e-5, 1e-6 },
+    { "impulse-patch", SIG_IMPULSE, { { -1, 0 } },
+        { { 1.2345, 10, 2, "CP_TEMPO_DIV_CH1" }, { 2.5, 12, 20, "CP_FB" },
+          { 0, -1, 0, NULL } }, 5e-3, 1e-5 },
+    { "impulse-host-tempo", SIG_IMPULSE, { { 6, 0 }, { -1, 0 } },
+        { { 0, 0, 120, "time:Position" }, { 1.3, 0, 100, "time:Position" },
+          { 2.2, 0, 100.02, "time:Position" }, { 0, -1, 0, NULL } },
+        5e-3, 1e-5 },
+    /* Enabled again during the fade out. The tap reaches further back than
+       the main delay and must not find anything from before. */
+    { "fade-reenable-taps", SIG_IMPULSE,
+        { { 9, 60 }, { 10, 5 }, { TAP(1, 1, 1), -6 }, { -1, 0 } },
+        { { 1.6, 4, 0, NULL }, { 1.62, 4, 1, NULL }, { 0, -1, 0, NULL } },
+        1e-5, 1e-6 },
+    { "trails", SIG_GATED, { { 5, 1 }, { -1, 0 } },
+        { { 1.0, 4, 0, NULL }, { 2.5, 4, 1, NULL }, { 0, -1, 0, NULL } },
+        1e-5, 1e-6 },
+    { "impulse-restore", SIG_IMPULSE, { { 6, 0 }, { 12, 70 }, { -1, 0 } },
+        { { 0, 0, 100, "time:Position" }, { 1.9, 0, 0, "state:restore" },
+          { 0, -1, 0, NULL } }, 1e-5, 1e-6 },
+    { "impulse-taps", SIG_IMPULSE,
+        { { TAP(1, 1, 1), -6 }, { TAP(1, 1, 2), 0 }, { TAP(1, 2, 1), -9 },
+          { TAP(2, 3, 1), -6 }, { TAP(2, 3, 3), 20 }, { 16, 1 }, { -1, 0 } },
+        { { 2.0, TAP(1, 2, 0), 5, NULL }, { 0, -1, 0, NULL } }, 1e-4, 1e-6 },
+    { "noise-limiter", SIG_NOISE,
+        { { 12, 100 }, { 13, 50 }, { 16, 1 }, { LIM_LOOKAHEAD, 1 },
+          { -1, 0 } },
+        { { 2.0, LIM_LINK, 1, NULL }, { 0, -1, 0, NULL } }, 2e-4, 2e-5 },
+};
+
+#define N_RENDER_CASES (sizeof(render_cases) / sizeof(render_cases[0]))
+
+static const double render_rates[] = { 44100, 96000 };
+
+#define N_RENDER_RATES (sizeof(render_rates) / sizeof(render_rates[0]))
+
+
+/**
+* Generates one block of a render case input signal.
+*/
+static void gen_signal(Signal sig, float* ch1, float* ch2, uint32_t n,
+    uint64_t pos, uint64_t len, double rate, uint32_t* seed) {
+    for (uint32_t i = 0 ; i < n ; ++i, ++pos) {
+        double t = pos / rate;
+        *seed = *seed * 1664525u + 1013904223u;
+        float v = ((*seed >> 8) / 8388608.f - 1.f) * 0.25f;
+        switch (sig) {
+            case SIG_IMPULSE:
+                ch1[i] = pos % (uint64_t)rate == 0;
+                ch2[i] = pos % (uint64_t)rate == (uint64_t)rate / 2;
+                break;
+            case SIG_SWEEP: {
+                double T = (double)len / rate;
+                double k = log(1000.);
+                double ph = 2 * M_PI * 20 * T / k * (exp(t / T * k) - 1);
+                ch1[i] = 0.5 * sin(ph);
+                ch2[i] = 0.5 * cos(ph);
+                break;
+            }
+            case SIG_NOISE:
+                ch1[i] = v;
+                ch2[i] = -v;
+                break;
+            case SIG_GATED:
+                ch1[i] = ch2[i] = (t >= 0.5 && t < 1.5) ? v : 0;
+                break;
+        }
+    }
+}
+
+
+/**
+* Instantiates the plugin for rendering, connects all ports and activates
+* it. With a state given, it's restored before activation.
+*/
+static LV2_Handle render_instance(const LV2_Descriptor* desc,
+    const LV2_Feature* const* features, double rate, float** audio,
+    float* ports, ControlBuffer* control, StateStore* state) {
+
+    LV2_Handle h = desc->instantiate(desc, rate, ".", features);
+    if (!h) {
+        fprintf(stderr, "instantiate failed at %.0f Hz\n", rate);
+        return NULL;
+    }
+
+    for (uint32_t p = 0 ; p < 4 ; ++p)
+        desc->connect_port(h, p, audio[p]);
+    for (uint32_t p = 4 ; p < MAX_PORTS ; ++p) {
+        if (p != CONTROL_PORT)
+            desc->connect_port(h, p, &ports[p]);
+    }
+    desc->connect_port(h, CONTROL_PORT, control);
+
+    if (state) {
+        const LV2_State_Interface* si = (const LV2_State_Interface*)
+            desc->extension_data(LV2_STATE__interface);
+        if (!si || si->restore(h, state_retrieve, state, 0, features)) {
+            fprintf(stderr, "restoring the state failed\n");
+            desc->cleanup(h);
+            return NULL;
+        }
+    }
+
+    desc->activate(h);
+    return h;
+}
+
+
+/**
+* Renders one case into an interleaved buffer of 2 * len floats.
+*/
+static int render(const LV2_Descriptor* desc,
+    const LV2_Feature* const* features, const RenderCase* rc, double rate,
+    float* out, uint64_t len) {
+
+    static float in_ch1[RENDER_BLOCK], in_ch2[RENDER_BLOCK];
+    static float out_ch1[RENDER_BLOCK], out_ch2[RENDER_BLOCK];
+    static ControlBuffer control;
+    float ports[MAX_PORTS];
+
+    default_ports(ports);
+    for (int i = 0 ; rc->set[i].port >= 0 ; ++i)
+        ports[rc->set[i].port] = rc->set[i].value;
+
+    float* res_ch1 = out_ch1;
+    float* res_ch2 = out_ch2;
+    if (in_place == 1) {
+        res_ch1 = in_ch1;
+        res_ch2 = in_ch2;
+    }
+    else if (in_place == 2) {
+        res_ch1 = in_ch2;
+        res_ch2 = in_ch1;
+    }
+
+    float* audio[4] = { in_ch1, in_ch2, res_ch1, res_ch2 };
+    LV2_Handle h = render_instance(desc, features, rate, audio, ports,
+        &control, NULL);
+    if (!h)
+        return 1;
+
+    uint32_t seed = 1;
+    int ev = 0;
+    double beat = 0, beat_t = 0, bpm = 120;
+    for (uint64_t pos = 0 ; pos < len ; pos += RENDER_BLOCK) {
+        uint32_t n = len - pos < RENDER_BLOCK ? len - pos : RENDER_BLOCK;
+
+        /* Port changes take effect at the next block boundary, patch:Set
+           messages at their frame */
+        seq_clear(&control);
+        while (rc->script[ev].port >= 0
+            && rc->script[ev].t * rate < pos + n) {
+            if (rc->script[ev].patch
+                && !strcmp(rc->script[ev].patch, "time:Position")) {
+                // Transport position of a host, that rolls along at bpm
+                beat += (rc->script[ev].t - beat_t) * bpm / 60;
+                beat_t = rc->script[ev].t;
+                bpm = rc->script[ev].value;
+                seq_position(&control,
+                    (int64_t)(rc->script[ev].t * rate) - (int64_t)pos,
+                    bpm, fmod(beat, 4));
+            }
+            else if (rc->script[ev].patch
+                && !strcmp(rc->script[ev].patch, "state:restore")) {
+                // Takes effect at the block boundary, like a session reload
+                StateStore state = { 0 };
+                const LV2_State_Interface* si = (const LV2_State_Interface*)
+                    desc->extension_data(LV2_STATE__interface);
+                if (!si || si->save(h, state_store, &state, 0, features)) {
+                    fprintf(stderr, "saving the state failed\n");
+                    desc->cleanup(h);
+                    return 1;
+                }
+                desc->deactivate(h);
+                desc->cleanup(h);
+                h = render_instance(desc, features, rate, audio, ports,
+                    &control, &state);
+                if (!h)
+                    return 1;
+            }
+            else if (rc->script[ev].patch)
+                seq_patch_set(&control,
+                    (int64_t)(rc->script[ev].t * rate) - (int64_t)pos,
+                    rc->script[ev].patch, rc->script[ev].value);
+            else
+                ports[rc->script[ev].port] = rc->script[ev].value;
+            ++ev;
+        }
+
+        gen_signal(rc->signal, in_ch1, in_ch2, n, pos, len, rate, &seed);
+        desc->run(h, n);
+        run_worker(desc, h);
+        for (uint32_t i = 0 ; i < n ; ++i) {
+            out[(pos + i) * 2] = res_ch1[i];
+            out[(pos + i) * 2 + 1] = res_ch2[i];
+        }
+    }
+
+    desc->deactivate(h);
+    desc->cleanup(h);
+    return 0;
+}
+
+
+/**
+* Renders all cases and either writes them to dir or compares them against
+* the references found there.
+*/
+static int render_all(const LV2_Descriptor* desc,
+    const LV2_Feature* const* features, const char* dir, int compare,
+    double only_rate, const char* only_case) {
+
+    int err = 0;
+
+    if (compare)
+        printf("%-20s %6s %12s %12s %12s %12s\n", "case", "rate",
+            "max-abs", "rms", "max-abs tol", "rms tol");
+
+    for (uint32_t r = 0 ; r < N_RENDER_RATES ; ++r) {
+        double rate = render_rates[r];
+        if (only_rate && rate != only_rate)
+            continue;
+
+        uint64_t len = RENDER_S * rate;
+        float* out = (float*)malloc(len * 2 * sizeof(float));
+        float* ref = (float*)malloc(len * 2 * sizeof(float));
+
+        for (uint32_t c = 0 ; c < N_RENDER_CASES ; ++c) {
+            const RenderCase* rc = &render_cases[c];
+            if (only_case && strcmp(only_case, rc->name))
+                continue;
+
+            char path[1024];
+            snprintf(path, sizeof(path), "%s/%s-%.0f.raw", dir, rc->name,
+                rate);
+
+            if (render(desc, features, rc, rate, out, len)) {
+                err = 1;
+                continue;
+            }
+
+            if (!compare) {
+                FILE* f = fopen(path, "wb");
+                if (!f || fwrite(out, sizeof(float), len * 2, f) != len * 2) {
+                    fprintf(stderr, "could not write %s\n", path);
+                    err = 1;
+                }
+                if (f)
+                    fclose(f);
+                continue;
+            }
+
+            FILE* f = fopen(path, "rb");
+            size_t got = f ? fread(ref, sizeof(float), len * 2, f) : 0;
+            if (f)
+                fclose(f);
+            if (got != len * 2) {
+                printf("%-20s %6.0f %12s\n", rc->name, rate,
+                    f ? "BAD LENGTH" : "MISSING");
+                err = 1;
+                continue;
+            }
+
+            double max_abs = 0, sum_sq = 0;
+            for (uint64_t i = 0 ; i < len * 2 ; ++i) {
+                double d = fabs((double)out[i] - ref[i]);
+                // NaN never compares greater, so catch it explicitly
+                if (d > max_abs || d != d)
+                    max_abs = d;
+                sum_sq += d * d;
+            }
+            double rms = sqrt(sum_sq / (len * 2));
+            int fail = !(max_abs <= rc->tolerance)
+                || !(rms <= rc->rms_tolerance);
+            printf("%-20s %6.0f %12.3g %12.3g %12.3g %12.3g%s\n", rc->name,
+                rate, max_abs, rms, rc->tolerance, rc->rms_tolerance,
+                fail ? "  FAIL" : "");
+            err |= fail;
+        }
+
+        free(out);
+        free(ref);
+    }
+
+    return err;
+}
+
+
+int main(int argc, char** argv) {
+    double only_rate = 0;
+    uint32_t only_block = 0;
+    const char* only_scenario = NULL;
+    const char* render_dir = NULL;
+    int compare = 0;
+    double seconds = 2;
+    uint32_t variant = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:b:c:s:v:R:C:ixpwh")) != -1) {
+        switch (opt) {
+            case 'r': only_rate = atof(optarg); break;
+            case 'b': only_block = atoi(optarg); break;
+            case 'c': only_scenario = optarg; break;
+            case 's': seconds = atof(optarg); break;
+            case 'v': variant = atoi(optarg); break;
+            case 'R': render_dir = optarg; compare = 0; break;
+            case 'C': render_dir = optarg; compare = 1; break;
+            case 'i': in_place = 1; break;
+            case 'x': in_place = 2; break;
+            case 'p': profile = 1; break;
+            case 'w': no_worker = 1; break;
+            default:
+                fprintf(stderr, "Usage: %s [-r rate] [-b block size] "
+                    "[-c scenario] [-s seconds] [-v variant] "
+                    "[-R dir | -C dir] [-i | -x] [-p] [-w]\n",
+                    argv[0]);
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (only_block > MAX_BLOCK) {
+        fprintf(stderr, "block size must not exceed %d\n", MAX_BLOCK);
+        return 1;
+    }
+
+    /* -ffast-math executables start with flush to zero enabled, hosts
+       don't. Clear it, so denormals cost what they cost in a host. */
+#if defined(__SSE__)
+    _mm_setcsr(_mm_getcsr() & ~0x8040);
+#elif defined(__aarch64__)
+    uint64_t fpcr;
+    __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+    __asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr & ~(1ull << 24)));
+#endif
+
+    const LV2_Descriptor* desc = lv2_descriptor(variant);
+    if (!desc || variant >= N_VARIANTS) {
+        fprintf(stderr, "no plugin descriptor %u\n", variant);
+        return 1;
+    }
+
+    LV2_URID_Map map = { NULL, map_uri };
+    LV2_Feature map_feature = { LV2_URID__map, &map };
+    LV2_Worker_Schedule schedule = { NULL, schedule_work };
+    LV2_Feature schedule_feature = { LV2_WORKER__schedule, &schedule };
+    const LV2_Feature* features[] = { &map_feature, &schedule_feature, NULL };
+    if (no_worker)
+        features[1] = NULL;
+
+    // Reference renders are stereo only
+    if (render_dir && variant) {
+        fprintf(stderr, "render cases need the stereo variant\n");
+        return 1;
+    }
+    if (render_dir)
+        return render_all(desc, features, render_dir, compare, only_rate,
+            only_scenario);
+
+    printf("%-12s %2s %6s %5s %9s %9s %9s %9s %9s\n", "scenario", "ch", "rate",
+        "block", "ns/smp", "rt-factor", "p50 us", "p99 us", "max us");
+
+    int err = 0;
+    for (uint32_t r = 0 ; r < N_RATES ; ++r) {
+        if (only_rate && rates[r] != only_rate)
+            continue;
+        for (uint32_t block = 16 ; block <= MAX_BLOCK ; block *= 2) {
+            if (only_block && block != only_block)
+                continue;
+            for (uint32_t s = 0 ; s < N_SCENARIOS ; ++s) {
+                if (only_scenario && strcmp(only_scenario, scenarios[s].name))
+                    continue;
+                err |= bench(desc, features, variant_channels[variant],
+                    &scenarios[s], rates[r], block, seconds);
+            }
+        }
+    }
+
+    return err;
+}
@@ -0,0 +1,69 @@
+# Derives the description of a multichannel variant from the stereo one.
+#
+# The audio ports are replaced by one input and one output per channel, the
+# control ports are moved up behind them and the plugin gets its own URI.
+# Everything else, including the parameter definitions, is kept as it is.
+#
+#   awk -v suffix=quad -v name=Quad -v kind=quadraphonic \
+#       -v chans="L R Ls Rs" -f variant.awk bolliedelayxt.ttl
+#
+# An empty chans makes a single channel without a suffix on the symbols.
+
+function port(cls, sym, label, idx, last) {
+    print "        a lv2:AudioPort ,"
+    print "            lv2:" cls " ;"
+    print "        lv2:index " idx " ;"
+    print "        lv2:symbol \"" sym "\" ;"
+    print "        lv2:name \"" label "\""
+    print last ? "    ] ;" : "    ] , ["
+}
+
+function ports(    i, n) {
+    n = nch ? nch : 1
+    print "    lv2:port ["
+    for (i = 1; i <= n; i++)
+        port("InputPort", nch ? "IP_INPUT_" toupper(ch[i]) : "IP_INPUT",
+            nch ? "In " ch[i] : "In", i - 1, 0)
+    for (i = 1; i <= n; i++)
+        port("OutputPort",
+            nch ? "OP_OUTPUT_" toupper(ch[i]) : "OP_OUTPUT",
+            nch ? "Out " ch[i] : "Out", n + i - 1, i == n)
+}
+
+BEGIN {
+    nch = split(chans, ch, " ")
+    shift = 2 * (nch ? nch : 1) - 4
+    audio = 0
+}
+
+/^<https:\/\/ca9\.eu\/lv2\/bolliedelayxt>$/ {
+    print "<https://ca9.eu/lv2/bolliedelayxt-" suffix ">"
+    next
+}
+
+/doap:name "Bollie Delay XT"/ {
+    sub(/"Bollie Delay XT"/, "\"Bollie Delay XT " name "\"")
+}
+
+# The first port statement holds the stereo audio ports
+/^    lv2:port \[$/ && audio == 0 {
+    audio = 1
+    ports()
+    next
+}
+
+audio == 1 {
+    if ($0 ~ /^    \] ;$/)
+        audio = 2
+    next
+}
+
+/^ *lv2:index [0-9]+ ;$/ {
+    sub(/index [0-9]+/, "index " ($2 + shift))
+}
+
+/This stereo tempo delay/ {
+    sub(/This stereo/, "This " kind)
+}
+
+{ print }
@@ -26,30 +26,96 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdbool.h>
 #include <math.h>
 #include <string.h>
+#include "bolliedenormal.h"
 #include "bolliefilter.h"
+#include "bollieinterp.h"
+#include "bollielimiter.h"
+#include "bollielfo.h"
+#include "bolliemem.h"
+#include "bollieprofile.h"
+#include "bolliesmooth.h"
+#include "bolliestorage.h"
+#include "bollietap.h"
 
 #include "lv2/lv2plug.in/ns/lv2core/lv2.h"
-
-#define URI "https://ca9.eu/lv2/bolliedelayxt"
-
-// Max buffer size == 192k * 10 seconds (max delay time) + a bit for modulation
-#define TWO_PI (M_PI*2)
-#define MAX_BUF_SIZE 769000
+#include "lv2/lv2plug.in/ns/ext/atom/atom.h"
+#include "lv2/lv2plug.in/ns/ext/atom/util.h"
+#include "lv2/lv2plug.in/ns/ext/options/options.h"
+#include "lv2/lv2plug.in/ns/ext/patch/patch.h"
+#include "lv2/lv2plug.in/ns/ext/state/state.h"
+#include "lv2/lv2plug.in/ns/ext/time/time.h"
+#include "lv2/lv2plug.in/ns/ext/urid/urid.h"
+#include "lv2/lv2plug.in/ns/ext/worker/worker.h"
+
+#define PLUGIN_URI "https://ca9.eu/lv2/bolliedelayxt"
+#define PLUGIN_URI_MONO PLUGIN_URI "-mono"
+#define PLUGIN_URI_QUAD PLUGIN_URI "-quad"
+#define PLUGIN_URI_51 PLUGIN_URI "-51"
+#define URI_MAX_DELAY PLUGIN_URI "#maxDelay"
+#define URI_HOST_TEMPO PLUGIN_URI "#hostTempo"
+#define URI_DELAY_CH1 PLUGIN_URI "#delayCh1"
+#define URI_DELAY_CH2 PLUGIN_URI "#delayCh2"
+#define URI_GAIN_DRY PLUGIN_URI "#gainDry"
+#define URI_GAIN_WET PLUGIN_URI "#gainWet"
+#define URI_FEEDBACK PLUGIN_URI "#feedback"
+#define URI_CROSSFEED PLUGIN_URI "#crossfeed"
+
+// Longest delay possible with the tempo range: 20 BPM quarter notes
+#define MAX_DELAY_S_DEFAULT 3.f
+#define MAX_DELAY_S_MIN 0.1f
+#define MAX_DELAY_S_MAX 60.f
+// Samples mirrored past the end of the ring, so interpolation never wraps
+#define BUF_GUARD 8
+#if BUF_GUARD < BI_GUARD_NEEDED
+#error "BUF_GUARD is too small for the interpolation kernels"
+#endif
+// Samples of the delay lines committed ahead of the write head
+#define COMMIT_AHEAD 8192
+// Maximum number of samples processed by one pass of the block pipeline
+#define BLOCK_SIZE 256
 #define FADE_LENGTH_MS 50
+#define JUMP_LENGTH_MS 30             ///< crossfade of a delay time jump
 #define MOD_OFFSET_MS 5.f
+#define MOD_PHASE_GLIDE_MS 50.f
+// Time constants of the parameter smoothers, about 0.99 and 0.999 per sample
+// at 48 kHz
+#define SMOOTH_MS 2.f
+#define SMOOTH_DELAY_MS 20.f
+#define SMOOTH_EPS 1e-6f              ///< gains and depth settle within
+#define SMOOTH_DELAY_EPS 1e-3f        ///< delay times settle within, samples
 #define LIM_ATTACK 10.f
 #define LIM_RELEASE 10.f
+#define IDLE_LEVEL 1e-6f              ///< -120 dBFS, silence for idle mode
+#define TEMPO_HYSTERESIS 0.05f        ///< host tempo jitter ignored, BPM
+// Most channels of a variant, frames are padded to the filter bank width
+#define MAX_CHANNELS 6
+#if MAX_CHANNELS > BF_CHANNELS
+#error "MAX_CHANNELS exceeds the filter banks"
+#endif
+#if BLOCK_SIZE > BSM_BLOCK
+#error "BLOCK_SIZE exceeds the ramps of the smoothers"
+#endif
 
 /**
-* Make a bool type available. ;)
+* Ports of a tap, relative to its first port
 */
-typedef enum { false, true } bool;
-
+typedef enum {
+    TP_DIV,
+    TP_GAIN,
+    TP_PAN,
+    TP_FB,
+    TP_PORTS
+} TapPortIdx;
 
 /**
-* Enumeration of LV2 ports
+* Enumeration of LV2 ports of the stereo variant. The taps of each channel
+* follow CP_CONTROL, one after the other, then the limiter settings. The
+* load outputs come last, an average and a maximum for each BollieStage.
+* The other variants have as many inputs and outputs as channels, followed
+* by the same control ports.
 */
 typedef enum {
     IP_INPUT_CH1,
@@ -84,9 +150,106 @@ typedef enum {
     CP_LCF_FB_ON,
     CP_LCF_FB_FREQ,
     CP_LCF_FB_Q,
-    CP_TEMPO_OUT
+    CP_TEMPO_OUT,
+    CP_INTERP,
+    CP_MOD_SHAPE,
+    CP_CONTROL,
+    CP_TAPS_CH1,
+    CP_TAPS_CH2 = CP_TAPS_CH1 + BT_TAPS * TP_PORTS,
+    CP_TAPS_END = CP_TAPS_CH2 + BT_TAPS * TP_PORTS,
+    CP_LIM_LINK = CP_TAPS_END,
+    CP_LIM_LOOKAHEAD,
+    CP_DELAY_JUMP,
+    CP_PROFILE,
+    CP_PARAMS_END,
+    CP_PROFILE_OUT = CP_PARAMS_END,
+    CP_PORTS_END = CP_PROFILE_OUT + 2 * BPR_VALUES
 } PortIdx;
 
+/**
+* Number of parameters, one per port from CP_ENABLED to the last input port
+*/
+#define N_PARAMS (CP_PARAMS_END - CP_ENABLED)
+
+/**
+* Parameter URIs for patch:Set, named after the port symbols. CP_TEMPO_OUT and
+* CP_CONTROL have none, those of the taps are put together by map_urids().
+*/
+static const char* param_uris[N_PARAMS] = {
+    [CP_ENABLED - CP_ENABLED] = PLUGIN_URI "#CP_ENABLED",
+    [CP_TRAILS - CP_ENABLED] = PLUGIN_URI "#CP_TRAILS",
+    [CP_TEMPO_MODE - CP_ENABLED] = PLUGIN_URI "#CP_TEMPO_MODE",
+    [CP_PING_PONG - CP_ENABLED] = PLUGIN_URI "#CP_PING_PONG",
+    [CP_TEMPO_HOST - CP_ENABLED] = PLUGIN_URI "#CP_TEMPO_HOST",
+    [CP_TEMPO_USER - CP_ENABLED] = PLUGIN_URI "#CP_TEMPO_USER",
+    [CP_TEMPO_DIV_CH1 - CP_ENABLED] = PLUGIN_URI "#CP_TEMPO_DIV_CH1",
+    [CP_TEMPO_DIV_CH2 - CP_ENABLED] = PLUGIN_URI "#CP_TEMPO_DIV_CH2",
+    [CP_FB - CP_ENABLED] = PLUGIN_URI "#CP_FB",
+    [CP_CF - CP_ENABLED] = PLUGIN_URI "#CP_CF",
+    [CP_GAIN_DRY - CP_ENABLED] = PLUGIN_URI "#CP_GAIN_DRY",
+    [CP_GAIN_WET - CP_ENABLED] = PLUGIN_URI "#CP_GAIN_WET",
+    [CP_MOD_ON - CP_ENABLED] = PLUGIN_URI "#CP_MOD_ON",
+    [CP_MOD_PHASE - CP_ENABLED] = PLUGIN_URI "#CP_MOD_PHASE",
+    [CP_MOD_DEPTH - CP_ENABLED] = PLUGIN_URI "#CP_MOD_DEPTH",
+    [CP_MOD_RATE - CP_ENABLED] = PLUGIN_URI "#CP_MOD_RATE",
+    [CP_HCF_PRE_ON - CP_ENABLED] = PLUGIN_URI "#CP_HCF_PRE_ON",
+    [CP_HCF_PRE_FREQ - CP_ENABLED] = PLUGIN_URI "#CP_HCF_PRE_FREQ",
+    [CP_HCF_PRE_Q - CP_ENABLED] = PLUGIN_URI "#CP_HCF_PRE_Q",
+    [CP_LCF_PRE_ON - CP_ENABLED] = PLUGIN_URI "#CP_LCF_PRE_ON",
+    [CP_LCF_PRE_FREQ - CP_ENABLED] = PLUGIN_URI "#CP_LCF_PRE_FREQ",
+    [CP_LCF_PRE_Q - CP_ENABLED] = PLUGIN_URI "#CP_LCF_PRE_Q",
+    [CP_HCF_FB_ON - CP_ENABLED] = PLUGIN_URI "#CP_HCF_FB_ON",
+    [CP_HCF_FB_FREQ - CP_ENABLED] = PLUGIN_URI "#CP_HCF_FB_FREQ",
+    [CP_HCF_FB_Q - CP_ENABLED] = PLUGIN_URI "#CP_HCF_FB_Q",
+    [CP_LCF_FB_ON - CP_ENABLED] = PLUGIN_URI "#CP_LCF_FB_ON",
+    [CP_LCF_FB_FREQ - CP_ENABLED] = PLUGIN_URI "#CP_LCF_FB_FREQ",
+    [CP_LCF_FB_Q - CP_ENABLED] = PLUGIN_URI "#CP_LCF_FB_Q",
+    [CP_INTERP - CP_ENABLED] = PLUGIN_URI "#CP_INTERP",
+    [CP_MOD_SHAPE - CP_ENABLED] = PLUGIN_URI "#CP_MOD_SHAPE",
+    [CP_LIM_LINK - CP_ENABLED] = PLUGIN_URI "#CP_LIM_LINK",
+    [CP_LIM_LOOKAHEAD - CP_ENABLED] = PLUGIN_URI "#CP_LIM_LOOKAHEAD",
+    [CP_DELAY_JUMP - CP_ENABLED] = PLUGIN_URI "#CP_DELAY_JUMP",
+    [CP_PROFILE - CP_ENABLED] = PLUGIN_URI "#CP_PROFILE"
+};
+
+/**
+* Names of the tap ports, as used in their symbols
+*/
+static const char* tap_port_names[TP_PORTS] = {
+    [TP_DIV] = "DIV",
+    [TP_GAIN] = "GAIN",
+    [TP_PAN] = "PAN",
+    [TP_FB] = "FB"
+};
+
+
+/**
+* Channel layout of a plugin variant. Even channels follow the ch1 ports for
+* division and taps, odd ones the ch2 ports.
+*/
+typedef struct {
+    const char* uri;            ///< plugin URI of the variant
+    uint32_t channels;          ///< number of channels
+    int8_t pair[MAX_CHANNELS];  ///< crossfeed partner of each line, which
+                                ///< also shares the tap outputs, or -1
+    int8_t ring[MAX_CHANNELS];  ///< line feeding each line in ping pong
+                                ///< mode, or -1
+} BollieLayout;
+
+/**
+* Layouts by descriptor index: stereo, mono, quad (L R Ls Rs) and 5.1
+* (L R C LFE Ls Rs). Ping pong runs around the speakers, L, R, Rs, Ls and
+* back to L, leaving C and LFE dry.
+*/
+static const BollieLayout layouts[] = {
+    { PLUGIN_URI, 2, { 1, 0 }, { 1, 0 } },
+    { PLUGIN_URI_MONO, 1, { -1 }, { 0 } },
+    { PLUGIN_URI_QUAD, 4, { 1, 0, 3, 2 }, { 2, 0, 3, 1 } },
+    { PLUGIN_URI_51, 6, { 1, 0, -1, -1, 5, 4 }, { 4, 0, -1, -1, 5, 1 } }
+};
+
+#define N_LAYOUTS (sizeof(layouts) / sizeof(layouts[0]))
+
 
 /**
 * State enum
@@ -106,98 +269,198 @@ typedef struct {
 } BollieParam;
 
 
+/**
+* Mapped URIs
+*/
+typedef struct {
+    LV2_URID atom_Blank;
+    LV2_URID atom_Bool;
+    LV2_URID atom_Double;
+    LV2_URID atom_Float;
+    LV2_URID atom_Int;
+    LV2_URID atom_Long;
+    LV2_URID atom_Object;
+    LV2_URID atom_URID;
+    LV2_URID patch_Set;
+    LV2_URID patch_property;
+    LV2_URID patch_value;
+    LV2_URID time_Position;
+    LV2_URID time_barBeat;
+    LV2_URID time_beatsPerMinute;
+    LV2_URID time_speed;
+    LV2_URID state_hostTempo;
+    LV2_URID state_delayCh1;
+    LV2_URID state_delayCh2;
+    LV2_URID state_gainDry;
+    LV2_URID state_gainWet;
+    LV2_URID state_feedback;
+    LV2_URID state_crossfeed;
+} BollieUrids;
+
+
+/**
+* Settled state, restored through the LV2 State extension and taken over by
+* the first run() afterwards
+*/
+typedef struct {
+    bool valid;                 ///< a restored state is waiting
+    float host_bpm;             ///< host tempo from time:Position, or 0
+    float d_t_ch1;              ///< delay time of ch1 in seconds
+    float d_t_ch2;              ///< delay time of ch2 in seconds
+    float gain_dry;
+    float gain_wet;
+    float fb;
+    float cf;
+} BollieWarm;
+
+
+/**
+* Request to the worker, to commit more of the delay lines
+*/
+typedef struct {
+    uint32_t gen;               ///< ring_gen at the time of the request
+    int32_t from;               ///< first sample to commit
+    int32_t to;                 ///< sample to commit up to
+} BollieRingWork;
+
+
+/**
+* Control port values, read once per run() and shared by the processing
+* paths.
+*/
+typedef struct {
+    float cp_enabled;
+    float cp_trails;
+    float cp_ping_pong;
+    float cp_mod_on;
+    float cp_mod_phase;
+    float cp_mod_depth;
+    float cp_mod_rate;
+    float cp_hcf_pre_on;
+    float cp_hcf_pre_freq;
+    float cp_hcf_pre_q;
+    float cp_lcf_pre_on;
+    float cp_lcf_pre_freq;
+    float cp_lcf_pre_q;
+    float cp_hcf_fb_on;
+    float cp_hcf_fb_freq;
+    float cp_hcf_fb_q;
+    float cp_lcf_fb_on;
+    float cp_lcf_fb_freq;
+    float cp_lcf_fb_q;
+    float cp_delay_jump;
+    BollieInterp interp;        ///< kernel used for the delay reads
+    float mod_rot_c;            ///< cosine of the odd channels' LFO phase
+                                ///< offset
+    float mod_rot_s;            ///< sine of the odd channels' LFO phase
+                                ///< offset
+} BollieCtl;
+
+
 /**
 * Struct for THE BollieDelayXT instance, the host is going to use.
 */
 typedef struct {
     double sample_rate;               ///< Current sample rate
 
-    float buffer_ch1[MAX_BUF_SIZE];  ///<< delay buffer for channel 1
-    float buffer_ch2[MAX_BUF_SIZE];  ///<< delay buffer for channel 2
+    const BollieLayout *layout;       ///< channel layout of the variant
+    uint32_t channels;                ///< number of channels
+    float xfeed[2][MAX_CHANNELS][BF_CHANNELS]; ///< crossfeed matrix for
+                                      ///< normal and ping pong mode, by
+                                      ///< source line and destination line
+    float pp_in;                      ///< input gain into the first line
+                                      ///< in ping pong mode
+
+    bs_sample *buffer[MAX_CHANNELS];  ///< delay buffer per channel
+    int32_t buf_size;                 ///< ring size in samples, power of two
+    int32_t buf_mask;                 ///< buf_size - 1, used for wrapping
     
-    const float *cp_enabled;
-    const float *cp_trails;
-    const float *cp_tempo_mode;
-    const float *cp_ping_pong;
-    const float *cp_tempo_host;
-    const float *cp_tempo_user;
-    const float *cp_tempo_div_ch1;
-    const float *cp_tempo_div_ch2;
-    const float *cp_fb;
-    const float *cp_cf;
-    const float *cp_gain_dry;
-    const float *cp_gain_wet;
-    const float *cp_mod_on;
-    const float *cp_mod_phase;
-    const float *cp_mod_depth;
-    const float *cp_mod_rate;
-    const float *cp_hcf_pre_on;
-    const float *cp_hcf_pre_freq;
-    const float *cp_hcf_pre_q;
-    const float *cp_lcf_pre_on;
-    const float *cp_lcf_pre_freq;
-    const float *cp_lcf_pre_q;
-    const float *cp_hcf_fb_on;
-    const float *cp_hcf_fb_freq;
-    const float *cp_hcf_fb_q;
-    const float *cp_lcf_fb_on;
-    const float *cp_lcf_fb_freq;
-    const float *cp_lcf_fb_q;
+    const float *cp[N_PARAMS];        ///< control ports, by PortIdx
+                                      ///< minus CP_ENABLED
     float *cp_tempo_out;
-
-    BollieFilter fil_hcf_fb_ch1;
-    BollieFilter fil_hcf_fb_ch2;
-    BollieFilter fil_lcf_fb_ch1;
-    BollieFilter fil_lcf_fb_ch2;
-    BollieFilter fil_hcf_pre_ch1;
-    BollieFilter fil_hcf_pre_ch2;
-    BollieFilter fil_lcf_pre_ch1;
-    BollieFilter fil_lcf_pre_ch2;
-
-    const float *input_ch1;
-    const float *input_ch2;
-
-    float *output_ch1;
-    float *output_ch2;
+    float *cp_profile_out[2 * BPR_VALUES]; ///< average and maximum of each
+                                      ///< BollieStage
+    const LV2_Atom_Sequence *cp_control;
+
+    float params[N_PARAMS];           ///< parameter values, from the ports
+                                      ///< or set through patch:Set
+    float params_port[N_PARAMS];      ///< port values seen last
+    bool params_valid;                ///< params hold the port values
+    LV2_URID params_urid[N_PARAMS];   ///< patch:property of each parameter
+    BollieUrids urids;
+
+    // Filters, all channels are run in one bank
+    BollieFilterBank fil_hcf_fb;
+    BollieFilterBank fil_lcf_fb;
+    BollieFilterBank fil_hcf_pre;
+    BollieFilterBank fil_lcf_pre;
+
+    const float *input[MAX_CHANNELS];
+    float *output[MAX_CHANNELS];
+    bool crossed;                     ///< an output shares its buffer with
+                                      ///< the input of another channel
 
     BollieState state;
 
-    float cur_cf;
-    float cur_fb;
-
     float cur_cp_gain_dry;
     float cur_cp_gain_wet;
 
     float cur_cp_cf;
     float cur_cp_fb;
 
-    float cur_gain_dry;
-    float cur_gain_wet;
-    float cur_gain_buf_in;
+    // Parameter smoothers
+    BollieSmooth sm_cf;
+    BollieSmooth sm_fb;
+    BollieSmooth sm_gain_dry;
+    BollieSmooth sm_gain_wet;
+    BollieSmooth sm_gain_buf_in;
+    BollieSmooth sm_mod_depth;
+    BollieSmooth sm_d_t[MAX_CHANNELS];  ///< delay time per channel
 
-    float cur_mod_depth;
-    float cur_mod_rate;
-    float cur_mod_phase;
+    float cur_mod_phase;              ///< LFO phase offset of the odd
+                                      ///< channels in radians
 
     float cur_tempo;
+
+    float host_bpm;                   ///< host tempo, after hysteresis
+    bool host_bpm_atom;               ///< host tempo comes from time:Position
+    float host_speed;                 ///< transport speed, 0 when stopped
+    float pending_bpm;                ///< host tempo for the next beat, or 0
+    uint32_t pending_frames;          ///< frames until the next beat
+
+    BollieWarm warm;                  ///< restored state for a warm start
     float cur_tempo_div_ch1;
     float cur_tempo_div_ch2;
+    bool cur_delay_jump;
 
-    float cur_d_t_ch1;
-    float cur_d_t_ch2;
-
-    float lfo_incr;
-    float lfo_curphase;
-    float lfo_circle;
+    BollieLfo lfo;
+    float ms_to_samples;
 
     int32_t fade_length;
     int32_t fade_pos;
 
+    int32_t jump_length;
+    int32_t jump_pos;                 ///< samples into the crossfade of a
+                                      ///< delay jump, jump_length if none
+    float jump_from[MAX_CHANNELS];    ///< delay time of the old read heads
+
     int32_t pos_w;
     uint32_t mod_offset_samples;
-
-    float tgt_d_t_ch1;
-    float tgt_d_t_ch2;
+    int32_t quiet_count;              ///< samples since anything audible
+                                      ///< was written to the delay lines
+    int32_t lines_clean;              ///< samples behind pos_w, that have
+                                      ///< been written since activate()
+    int32_t lines_used;               ///< samples from the start of the
+                                      ///< lines ever written, zero beyond
+    int32_t ring_ready;               ///< samples from the start of the
+                                      ///< lines, that are committed
+    bool ring_pending;                ///< the worker commits more
+    uint32_t ring_gen;                ///< activations, tells apart worker
+                                      ///< replies from before
+    const LV2_Worker_Schedule *schedule; ///< host worker, NULL if the lines
+                                      ///< are committed up front
+
+    float tgt_d_t[BF_CHANNELS];
 
     float tgt_cf;
     float tgt_fb;
@@ -205,39 +468,236 @@ typedef struct {
     float tgt_gain_dry;
     float tgt_gain_wet;
 
-    float lim_attack;
-    float lim_release;
-    float lim_envelope_ch1;
-    float lim_envelope_ch2;
-    
+    BollieLimiter limiter;            ///< limiter of the feedback path
+    BollieProfile profile;            ///< stage timing for the load ports
+
+    bool ap_active;                   ///< allpass interpolators are primed
+    BollieAllpass ap[MAX_CHANNELS];
+
+    BollieTaps taps[MAX_CHANNELS];    ///< additional read heads per channel
+
+    float pow_fast[BLOCK_SIZE];       ///< decay of the tap smoothers
+    float pow_slow[BLOCK_SIZE];       ///< after i+1 samples, fast and slow
+
+    // Scratch arrays of the block pipeline
+    float blk_lfo[2][BLOCK_SIZE];     ///< even and odd channels
+    float blk_read[BLOCK_SIZE];       ///< read distance with lookahead
+    float blk_jump[2][BLOCK_SIZE];    ///< gains of the old and new heads
+    float blk_jump_old[BLOCK_SIZE];   ///< samples of an old read head
+    float blk_old[MAX_CHANNELS][BLOCK_SIZE];
+    float blk_fil[MAX_CHANNELS][BLOCK_SIZE];
+    float blk_buf[MAX_CHANNELS][BLOCK_SIZE];
+    float blk_tap[MAX_CHANNELS][BLOCK_SIZE];
+    float blk_tap_fb[MAX_CHANNELS][BLOCK_SIZE];
+
 } BollieDelayXT;
 
 
+/**
+* Looks up the maximum delay time in seconds in the options passed by the
+* host. Falls back to the longest delay the tempo range can produce.
+* \param features host features as passed to instantiate()
+* \return maximum delay time in seconds
+*/
+static float get_max_delay(const LV2_Feature* const* features) {
+    const LV2_URID_Map* map = NULL;
+    const LV2_Options_Option* options = NULL;
+    float max_delay = MAX_DELAY_S_DEFAULT;
+
+    for (int i = 0 ; features && features[i] ; ++i) {
+        if (!strcmp(features[i]->URI, LV2_URID__map))
+            map = (const LV2_URID_Map*)features[i]->data;
+        else if (!strcmp(features[i]->URI, LV2_OPTIONS__options))
+            options = (const LV2_Options_Option*)features[i]->data;
+    }
+
+    if (!map || !options)
+        return max_delay;
+
+    LV2_URID key = map->map(map->handle, URI_MAX_DELAY);
+    LV2_URID atom_float = map->map(map->handle, LV2_ATOM__Float);
+    for (const LV2_Options_Option* o = options ; o->key ; ++o) {
+        if (o->key == key && o->type == atom_float)
+            max_delay = *(const float*)o->value;
+    }
+
+    if (max_delay < MAX_DELAY_S_MIN)
+        max_delay = MAX_DELAY_S_MIN;
+    else if (max_delay > MAX_DELAY_S_MAX)
+        max_delay = MAX_DELAY_S_MAX;
+
+    return max_delay;
+}
+
+
+/**
+* Maps the URIs needed to parse parameter changes.
+* \param self pointer to current plugin instance.
+* \param map URID map feature of the host
+*/
+static void map_urids(BollieDelayXT* self, const LV2_URID_Map* map) {
+    BollieUrids* u = &self->urids;
+    u->atom_Blank = map->map(map->handle, LV2_ATOM__Blank);
+    u->atom_Bool = map->map(map->handle, LV2_ATOM__Bool);
+    u->atom_Double = map->map(map->handle, LV2_ATOM__Double);
+    u->atom_Float = map->map(map->handle, LV2_ATOM__Float);
+    u->atom_Int = map->map(map->handle, LV2_ATOM__Int);
+    u->atom_Long = map->map(map->handle, LV2_ATOM__Long);
+    u->atom_Object = map->map(map->handle, LV2_ATOM__Object);
+    u->atom_URID = map->map(map->handle, LV2_ATOM__URID);
+    u->patch_Set = map->map(map->handle, LV2_PATCH__Set);
+    u->patch_property = map->map(map->handle, LV2_PATCH__property);
+    u->patch_value = map->map(map->handle, LV2_PATCH__value);
+    u->time_Position = map->map(map->handle, LV2_TIME__Position);
+    u->time_barBeat = map->map(map->handle, LV2_TIME__barBeat);
+    u->time_beatsPerMinute = map->map(map->handle, LV2_TIME__beatsPerMinute);
+    u->time_speed = map->map(map->handle, LV2_TIME__speed);
+    u->state_hostTempo = map->map(map->handle, URI_HOST_TEMPO);
+    u->state_delayCh1 = map->map(map->handle, URI_DELAY_CH1);
+    u->state_delayCh2 = map->map(map->handle, URI_DELAY_CH2);
+    u->state_gainDry = map->map(map->handle, URI_GAIN_DRY);
+    u->state_gainWet = map->map(map->handle, URI_GAIN_WET);
+    u->state_feedback = map->map(map->handle, URI_FEEDBACK);
+    u->state_crossfeed = map->map(map->handle, URI_CROSSFEED);
+
+    for (int i = 0 ; i < N_PARAMS ; ++i) {
+        if (param_uris[i])
+            self->params_urid[i] = map->map(map->handle, param_uris[i]);
+    }
+
+    for (int p = CP_TAPS_CH1 ; p < CP_TAPS_END ; ++p) {
+        char uri[128];
+        int i = (p - CP_TAPS_CH1) % (BT_TAPS * TP_PORTS);
+        snprintf(uri, sizeof(uri), PLUGIN_URI "#CP_TAP%d_%s_CH%d",
+            i / TP_PORTS + 1, tap_port_names[i % TP_PORTS],
+            p < CP_TAPS_CH2 ? 1 : 2);
+        self->params_urid[p - CP_ENABLED] = map->map(map->handle, uri);
+    }
+}
+
+
+/**
+* Fills in the crossfeed matrices of a layout. In normal mode each line
+* feeds its pair, in ping pong mode the line next in the ring. The input
+* goes to the first line only then, summed across the channels.
+* \param self pointer to current plugin instance.
+* \param layout channel layout of the variant
+*/
+static void set_layout(BollieDelayXT* self, const BollieLayout* layout) {
+    self->layout = layout;
+    self->channels = layout->channels;
+    memset(self->xfeed, 0, sizeof(self->xfeed));
+    for (uint32_t c = 0 ; c < layout->channels ; ++c) {
+        if (layout->pair[c] >= 0)
+            self->xfeed[0][layout->pair[c]][c] = 1.f;
+        if (layout->ring[c] >= 0)
+            self->xfeed[1][layout->ring[c]][c] = 1.f;
+    }
+    self->pp_in = 1.f / layout->channels;
+}
+
+
 /**
 * Instantiates the plugin
-* Allocates memory for the BollieDelayXT object and returns a pointer as
-* LV2Handle.
+* Allocates memory for the BollieDelayXT object and its delay buffers and
+* returns a pointer as LV2Handle. The buffers are sized from the sample rate
+* and the maximum delay time. The variant is picked by the URI of the
+* descriptor.
 */
 static LV2_Handle instantiate(const LV2_Descriptor * descriptor, double rate,
     const char* bundle_path, const LV2_Feature* const* features) {
+
+    const BollieLayout* layout = NULL;
+    for (uint32_t i = 0 ; i < N_LAYOUTS ; ++i) {
+        if (!strcmp(descriptor->URI, layouts[i].uri))
+            layout = &layouts[i];
+    }
+    if (!layout)
+        return NULL;
     
-    BollieDelayXT *self = (BollieDelayXT*)calloc(1, sizeof(BollieDelayXT));
+    BollieDelayXT *self = (BollieDelayXT*)bm_alloc(sizeof(BollieDelayXT));
+    if (!self)
+        return NULL;
+    // Each run() gets to all of it sooner or later, commit it right away
+    bm_prefault(self, sizeof(BollieDelayXT));
 
     // Memorize sample rate for calculation
     self->sample_rate = rate;
+    set_layout(self, layout);
+
+    self->mod_offset_samples = ceil(MOD_OFFSET_MS / 1000 * rate);
+
+    // Delay line + modulation headroom, rounded up to a power of two
+    int32_t needed = ceil(get_max_delay(features) * rate)
+        + self->mod_offset_samples + 1;
+    self->buf_size = 1;
+    while (self->buf_size < needed)
+        self->buf_size <<= 1;
+    self->buf_mask = self->buf_size - 1;
+
+    /* The guard region mirrors the first BUF_GUARD samples of the ring,
+       followed by one dump slot for writes that need no mirroring. */
+    size_t line_bytes = (self->buf_size + BUF_GUARD + 1) * sizeof(bs_sample);
+    for (uint32_t c = 0 ; c < self->channels ; ++c) {
+        self->buffer[c] = (bs_sample*)bm_alloc(line_bytes);
+        if (!self->buffer[c]) {
+            while (c--)
+                bm_free(self->buffer[c], line_bytes);
+            bm_free(self, sizeof(BollieDelayXT));
+            return NULL;
+        }
+    }
 
     // Prepare fade stuff
     self->fade_length = ceil(rate / 1000 * FADE_LENGTH_MS);
     self->fade_pos = 0;
+    self->jump_length = ceil(rate / 1000 * JUMP_LENGTH_MS);
+    self->jump_pos = self->jump_length;
+
+    /* URIDs for parameter changes through the control port, the worker
+       commits the delay lines ahead of the write head */
+    for (int i = 0 ; features && features[i] ; ++i) {
+        if (!strcmp(features[i]->URI, LV2_URID__map))
+            map_urids(self, (const LV2_URID_Map*)features[i]->data);
+#ifndef BOLLIE_PREFAULT
+        else if (!strcmp(features[i]->URI, LV2_WORKER__schedule))
+            self->schedule = (const LV2_Worker_Schedule*)features[i]->data;
+#endif
+    }
 
-    self->mod_offset_samples = ceil(MOD_OFFSET_MS / 1000 * rate);
+    /* Without a worker, the audio thread would take the page faults, so
+       all pages are committed here */
+    if (!self->schedule) {
+        for (uint32_t c = 0 ; c < self->channels ; ++c)
+            bm_prefault(self->buffer[c], line_bytes);
+    }
+
+    // Interpolation tables are shared by all instances
+    bi_init();
 
     // LFO
-    self->lfo_circle = TWO_PI/(float)rate;
+    bl_init(&self->lfo, rate);
+    self->ms_to_samples = rate / 1000;
+
+    // Parameter smoothers, all settled at zero until activate()
+    bsm_init(&self->sm_cf, rate, SMOOTH_MS, SMOOTH_EPS, 0);
+    bsm_init(&self->sm_fb, rate, SMOOTH_MS, SMOOTH_EPS, 0);
+    bsm_init(&self->sm_gain_dry, rate, SMOOTH_MS, SMOOTH_EPS, 0);
+    bsm_init(&self->sm_gain_wet, rate, SMOOTH_MS, SMOOTH_EPS, 0);
+    bsm_init(&self->sm_gain_buf_in, rate, SMOOTH_MS, SMOOTH_EPS, 0);
+    bsm_init(&self->sm_mod_depth, rate, SMOOTH_MS, SMOOTH_EPS, 0);
+    for (uint32_t c = 0 ; c < self->channels ; ++c)
+        bsm_init(&self->sm_d_t[c], rate, SMOOTH_DELAY_MS, SMOOTH_DELAY_EPS,
+            0);
+
+    // Decay curves of the tap smoothers, same time constants
+    for (int i = 0 ; i < BLOCK_SIZE ; ++i) {
+        self->pow_fast[i] = exp(-(i + 1) / (SMOOTH_MS * 0.001 * rate));
+        self->pow_slow[i] = exp(-(i + 1) / (SMOOTH_DELAY_MS * 0.001 * rate));
+    }
 
-    // limiter
-    self->lim_attack  = powf(0.01f, 1.0f / (LIM_ATTACK * rate * 0.001f) ); 
-    self->lim_release = powf(0.01f, 1.0f / (LIM_RELEASE * rate * 0.001f) );
+    blm_init(&self->limiter, rate, self->channels, LIM_ATTACK, LIM_RELEASE);
+    bpr_init(&self->profile, rate);
 
     return (LV2_Handle)self;
 }
@@ -246,112 +706,37 @@ static LV2_Handle instantiate(const LV2_Descriptor * descriptor, double rate,
 /**
 * Used by the host to connect the ports of this plugin.
 * \param instance current LV2_Handle (will be cast to BollieDelayXT*)
-* \param port LV2 port index, maches the enum above.
+* \param port LV2 port index, the audio ports of all channels followed by
+*        the control ports in the order of the enum above.
 * \param data Pointer to the actual port data.
 */
 static void connect_port(LV2_Handle instance, uint32_t port, void *data) {
     BollieDelayXT *self = (BollieDelayXT*)instance;
+    uint32_t channels = self->channels;
+
+    if (port < channels) {
+        self->input[port] = data;
+        return;
+    }
+    if (port < 2 * channels) {
+        self->output[port - channels] = data;
+        return;
+    }
+    port = port - 2 * channels + CP_ENABLED;
 
     switch ((PortIdx)port) {
-        case IP_INPUT_CH1:
-            self->input_ch1 = data;
-            break;
-        case IP_INPUT_CH2:
-            self->input_ch2 = data;
-            break;
-        case OP_OUTPUT_CH1:
-            self->output_ch1 = data;
-            break;
-        case OP_OUTPUT_CH2:
-            self->output_ch2 = data;
-            break;
-        case CP_ENABLED:
-            self->cp_enabled = data;
-            break;
-        case CP_TRAILS:
-            self->cp_trails = data;
-            break;
-        case CP_PING_PONG:
-            self->cp_ping_pong = data;
-            break;
-        case CP_TEMPO_MODE:
-            self->cp_tempo_mode = data;
-            break;
-        case CP_TEMPO_HOST:
-            self->cp_tempo_host = data;
-            break;
-        case CP_TEMPO_USER:
-            self->cp_tempo_user = data;
-            break;
-        case CP_TEMPO_DIV_CH1:
-            self->cp_tempo_div_ch1 = data;
-            break;
-        case CP_TEMPO_DIV_CH2:
-            self->cp_tempo_div_ch2 = data;
-            break;
-        case CP_FB:
-            self->cp_fb = data;
-            break;
-        case CP_CF:
-            self->cp_cf = data;
-            break;
-        case CP_GAIN_DRY:
-            self->cp_gain_dry = data;
-            break;
-        case CP_GAIN_WET:
-            self->cp_gain_wet = data;
-            break;
-        case CP_MOD_ON:
-            self->cp_mod_on = data;
-            break;
-        case CP_MOD_PHASE:
-            self->cp_mod_phase = data;
-            break;
-        case CP_MOD_DEPTH:
-            self->cp_mod_depth = data;
-            break;
-        case CP_MOD_RATE:
-            self->cp_mod_rate = data;
-            break;
-        case CP_HCF_PRE_ON:
-            self->cp_hcf_pre_on = data;
-            break;
-        case CP_HCF_PRE_FREQ:
-            self->cp_hcf_pre_freq = data;
-            break;
-        case CP_HCF_PRE_Q:
-            self->cp_hcf_pre_q = data;
-            break;
-        case CP_LCF_PRE_ON:
-            self->cp_lcf_pre_on = data;
-            break;
-        case CP_LCF_PRE_FREQ:
-            self->cp_lcf_pre_freq = data;
-            break;
-        case CP_LCF_PRE_Q:
-            self->cp_lcf_pre_q = data;
-            break;
-        case CP_HCF_FB_ON:
-            self->cp_hcf_fb_on = data;
-            break;
-        case CP_HCF_FB_FREQ:
-            self->cp_hcf_fb_freq = data;
-            break;
-        case CP_HCF_FB_Q:
-            self->cp_hcf_fb_q = data;
-            break;
-        case CP_LCF_FB_ON:
-            self->cp_lcf_fb_on = data;
-            break;
-        case CP_LCF_FB_FREQ:
-            self->cp_lcf_fb_freq = data;
-            break;
-        case CP_LCF_FB_Q:
-            self->cp_lcf_fb_q = data;
-            break;
         case CP_TEMPO_OUT:
             self->cp_tempo_out = data;
             break;
+        case CP_CONTROL:
+            self->cp_control = data;
+            break;
+        default:
+            if (port >= CP_ENABLED && port < CP_ENABLED + N_PARAMS)
+                self->cp[port - CP_ENABLED] = data;
+            else if (port >= CP_PROFILE_OUT && port < CP_PORTS_END)
+                self->cp_profile_out[port - CP_PROFILE_OUT] = data;
+            break;
     }
 }
     
@@ -365,37 +750,68 @@ static void activate(LV2_Handle instance) {
     self->state = FILL_BUF;
     self->pos_w = 0;
     self->fade_pos = 0;
+    self->jump_pos = self->jump_length;
     self->cur_cp_gain_dry = -97.f;
     self->cur_cp_gain_wet = -97.f;
     self->cur_cp_cf = 0;
     self->cur_cp_fb = 0;
-    self->cur_gain_dry = 0;
-    self->cur_gain_wet = 0;
-    self->cur_mod_depth = 0;
-    self->cur_mod_rate = 0;
+    bsm_reset(&self->sm_gain_dry, 0);
+    bsm_reset(&self->sm_gain_wet, 0);
+    bsm_reset(&self->sm_mod_depth, 0);
     self->cur_mod_phase = 0;
-    self->cur_cf = 0;
-    self->cur_fb = 0;
+    bsm_reset(&self->sm_cf, 0);
+    bsm_reset(&self->sm_fb, 0);
     self->cur_tempo = 0;
-    self->lfo_curphase = 0.0f;
-    self->lfo_incr = 0;
-    self->cur_gain_buf_in = 0;
-    self->tgt_d_t_ch1 = 0.5f * self->sample_rate;
-    self->cur_d_t_ch1 = 0;
-    self->tgt_d_t_ch2 = 0.5f * self->sample_rate;
-    self->cur_d_t_ch2 = 0;
-
-    self->lim_envelope_ch1 = 0;
-    self->lim_envelope_ch2 = 0;
-
-    bf_init(&self->fil_hcf_fb_ch1);
-    bf_init(&self->fil_hcf_fb_ch2);
-    bf_init(&self->fil_lcf_fb_ch1);
-    bf_init(&self->fil_lcf_fb_ch2);
-    bf_init(&self->fil_hcf_pre_ch1);
-    bf_init(&self->fil_hcf_pre_ch2);
-    bf_init(&self->fil_lcf_pre_ch1);
-    bf_init(&self->fil_lcf_pre_ch2);
+    self->host_bpm = 0;
+    self->host_bpm_atom = false;
+    self->host_speed = 0;
+    self->pending_bpm = 0;
+    bl_reset(&self->lfo);
+    bsm_reset(&self->sm_gain_buf_in, 0);
+    for (uint32_t c = 0 ; c < self->channels ; ++c) {
+        self->tgt_d_t[c] = 0.5f * self->sample_rate;
+        bsm_reset(&self->sm_d_t[c], 0);
+        bt_init(&self->taps[c]);
+    }
+    blm_reset(&self->limiter);
+
+    self->ap_active = false;
+    // Nothing audible has been written since, see clear_ahead()
+    self->quiet_count = self->buf_size;
+    self->params_valid = false;
+
+    bfb_init(&self->fil_hcf_fb);
+    bfb_init(&self->fil_lcf_fb);
+    bfb_init(&self->fil_hcf_pre);
+    bfb_init(&self->fil_lcf_pre);
+
+    /* Whatever is left in the delay lines is cleared ahead of the read
+       heads, see clear_ahead() */
+    self->lines_clean = 0;
+
+    self->ring_pending = false;
+    ++self->ring_gen;
+    self->ring_ready = self->buf_size;
+    if (!self->schedule)
+        return;
+
+    /* The pages go back to the system and read as zero afterwards. The
+       start of the lines and the guard, that the write head mirrors into,
+       are committed again right away, the worker keeps ahead from there. */
+    const size_t s = sizeof(bs_sample);
+    int32_t ahead = self->buf_size < COMMIT_AHEAD ?
+        self->buf_size : COMMIT_AHEAD;
+    size_t line_bytes = (self->buf_size + BUF_GUARD + 1) * s;
+    bool trimmed = true;
+    for (uint32_t c = 0 ; c < self->channels ; ++c) {
+        char* line = (char*)self->buffer[c];
+        trimmed = !bm_trim(line, 0, line_bytes) && trimmed;
+        bm_commit(line, ahead * s);
+        bm_commit(line + self->buf_size * s, (BUF_GUARD + 1) * s);
+    }
+    if (trimmed)
+        self->lines_used = 0;
+    self->ring_ready = ahead;
 }
 
 
@@ -431,270 +847,588 @@ static float calc_delay_samples(BollieDelayXT* self, float tempo, int div) {
 }
 
 /**
-* linear sample interpolation from buffer
+* Writes a sample to the ring and keeps the guard region in sync.
 * \param buf pointer to the buffer
-* \param x sample coordinate. Can be also negative.
-* \return interpolated sample
+* \param size size of the ring in samples, power of two
+* \param pos write position, already wrapped
+* \param v sample value
 */
-static float interpolate(float *buf, double x) {
-    if (x < 0) x += MAX_BUF_SIZE;
-    if (x >= MAX_BUF_SIZE) x -= MAX_BUF_SIZE;
-    int32_t x0 = (int32_t)x;
-    float frac = x - (double)x0;
-    int32_t x1 = x0+1;
-    return buf[x0]  + frac * (buf[x1 >= MAX_BUF_SIZE ? 0 : x1] - buf[x0]);
+static inline void write_sample(bs_sample *buf, int32_t size, int32_t pos,
+    float v) {
+    bs_sample s = bs_store(v);
+    buf[pos] = s;
+    buf[size + (pos < BUF_GUARD ? pos : BUF_GUARD)] = s;
 }
 
 
 /**
-* Main process function of the plugin.
-* \param instance  handle of the current plugin
-* \param n_samples number of samples in this current input block.
+* Writes a block of samples to the ring and keeps the guard region in sync.
+* \param buf pointer to the buffer
+* \param size size of the ring in samples, power of two
+* \param pos write position, already wrapped
+* \param src samples to write
+* \param n number of samples, not more than size
 */
-static void run(LV2_Handle instance, uint32_t n_samples) {
-    BollieDelayXT* self = (BollieDelayXT*)instance;
+static void write_block(bs_sample *buf, int32_t size, int32_t pos,
+    const float *src, uint32_t n) {
+    uint32_t n1 = (uint32_t)(size - pos) < n ? (uint32_t)(size - pos) : n;
+    bs_store_block(buf + pos, src, n1);
+    bs_store_block(buf, src + n1, n - n1);
+    memcpy(buf + size, buf, BUF_GUARD * sizeof(bs_sample));
+}
 
-    // Copy variables from heap to stack to speed up looping over the samples
-    float cur_cf = self->cur_cf;
-    float cur_fb = self->cur_fb;
-    float cur_d_t_ch1 = self->cur_d_t_ch1;
-    float cur_d_t_ch2 = self->cur_d_t_ch2;
-    float cur_gain_buf_in = self->cur_gain_buf_in;
-    float cur_gain_dry = self->cur_gain_dry;
-    float cur_gain_wet = self->cur_gain_wet;
-    float cur_mod_depth = self->cur_mod_depth;
-    float cur_mod_phase = self->cur_mod_phase;
-    float cur_mod_rate = self->cur_mod_rate;
-    float cp_enabled = *self->cp_enabled;
-    float cp_ping_pong = *self->cp_ping_pong;
-    float cp_hcf_fb_on = *self->cp_hcf_fb_on;
-    float cp_hcf_fb_freq = *self->cp_hcf_fb_freq;
-    float cp_hcf_fb_q = *self->cp_hcf_fb_q;
-    float cp_lcf_fb_on = *self->cp_lcf_fb_on;
-    float cp_lcf_fb_freq = *self->cp_lcf_fb_freq;
-    float cp_lcf_fb_q = *self->cp_lcf_fb_q;
-    float cp_hcf_pre_on = *self->cp_hcf_pre_on;
-    float cp_hcf_pre_freq = *self->cp_hcf_pre_freq;
-    float cp_hcf_pre_q = *self->cp_hcf_pre_q;
-    float cp_lcf_pre_on = *self->cp_lcf_pre_on;
-    float cp_lcf_pre_freq = *self->cp_lcf_pre_freq;
-    float cp_lcf_pre_q = *self->cp_lcf_pre_q;
-    float cp_mod_on = *self->cp_mod_on;
-    float cp_mod_phase = *self->cp_mod_phase;
-    float cp_mod_depth = *self->cp_mod_depth;
-    float cp_mod_rate = *self->cp_mod_rate;
-    float cp_trails = *self->cp_trails;
-    int32_t fade_pos = self->fade_pos;
-    int32_t fade_length = self->fade_length;
-    float lfo_curphase = self->lfo_curphase;
-    float lfo_incr = self->lfo_incr;
-    int32_t pos_w = self->pos_w;
-    double rate = self->sample_rate;
-    BollieState state = self->state;
-    float tgt_d_t_ch1 = self->tgt_d_t_ch1;
-    float tgt_d_t_ch2 = self->tgt_d_t_ch2;
-    float tgt_gain_dry = self->tgt_gain_dry;
-    float tgt_gain_wet = self->tgt_gain_wet;
-    float tgt_cf = self->tgt_cf;
-    float tgt_fb = self->tgt_fb;
-
-    float lim_attack = self->lim_attack;
-    float lim_release = self->lim_release;
-    float lim_envelope_ch1 = self->lim_envelope_ch1;
-    float lim_envelope_ch2 = self->lim_envelope_ch2;
 
-    // Tempo handling
-    // Tempo mode has changed
-    float cur_tempo = (*self->cp_tempo_mode == 1 ? *self->cp_tempo_user :
-        *self->cp_tempo_host);
+/**
+* Clears a block of the ring and keeps the guard region in sync.
+* \param buf pointer to the buffer
+* \param size size of the ring in samples, power of two
+* \param pos write position, already wrapped
+* \param n number of samples, not more than size
+*/
+static void clear_block(bs_sample *buf, int32_t size, int32_t pos,
+    uint32_t n) {
+    // All bits zero is zero in every storage format
+    uint32_t n1 = (uint32_t)(size - pos) < n ? (uint32_t)(size - pos) : n;
+    memset(buf + pos, 0, n1 * sizeof(bs_sample));
+    memset(buf, 0, (n - n1) * sizeof(bs_sample));
+    memcpy(buf + size, buf, BUF_GUARD * sizeof(bs_sample));
+}
 
-    // Tempo has changed
-    if (cur_tempo != self->cur_tempo 
-        || self->cur_tempo_div_ch1 != *self->cp_tempo_div_ch1
-        || self->cur_tempo_div_ch2 != *self->cp_tempo_div_ch2
-    ) {
-        tgt_d_t_ch1 = calc_delay_samples(self, cur_tempo, 
-            *self->cp_tempo_div_ch1);
 
-        tgt_d_t_ch2 = calc_delay_samples(self, cur_tempo, 
-            *self->cp_tempo_div_ch2);
+/**
+* Returns the peak level of a block of the ring.
+* \param buf pointer to the buffer
+* \param size size of the ring in samples, power of two
+* \param pos position of the first sample, already wrapped
+* \param n number of samples, not more than size
+* \return peak level
+*/
+static float ring_peak(const bs_sample *buf, int32_t size, int32_t pos,
+    uint32_t n) {
+    uint32_t n1 = (uint32_t)(size - pos) < n ? (uint32_t)(size - pos) : n;
+    float peak = 0;
+    for (uint32_t i = 0 ; i < n1 ; ++i)
+        peak = fmaxf(peak, fabsf(bs_load(buf[pos + i])));
+    for (uint32_t i = 0 ; i < n - n1 ; ++i)
+        peak = fmaxf(peak, fabsf(bs_load(buf[i])));
+    return peak;
+}
 
-        // Safety!
-        if (tgt_d_t_ch1 + self->mod_offset_samples >= MAX_BUF_SIZE) 
-            tgt_d_t_ch1 = MAX_BUF_SIZE-self->mod_offset_samples-1;
 
-        if (tgt_d_t_ch2 + self->mod_offset_samples >= MAX_BUF_SIZE)
-            tgt_d_t_ch2 = MAX_BUF_SIZE-self->mod_offset_samples-1;
+/**
+* Clears the part of a ring, that hasn't been written since activate() and
+* is about to come within reach of the read heads. Samples beyond
+* lines_used have never been written and are still zero.
+* \param self pointer to current plugin instance.
+* \param from first position to clear, unwrapped, may be negative
+* \param n number of samples
+*/
+static void clear_range(BollieDelayXT* self, int32_t from, int32_t n) {
+    int32_t pos = from & self->buf_mask;
+    while (n > 0) {
+        int32_t m = self->buf_size - pos < n ? self->buf_size - pos : n;
+        if (pos < self->lines_used) {
+            int32_t k = self->lines_used - pos < m ?
+                self->lines_used - pos : m;
+            for (uint32_t c = 0 ; c < self->channels ; ++c)
+                clear_block(self->buffer[c], self->buf_size, pos, k);
+        }
+        n -= m;
+        pos = 0;
+    }
+}
+
 
-        self->cur_tempo = cur_tempo;
-        self->cur_tempo_div_ch1 = *self->cp_tempo_div_ch1;
-        self->cur_tempo_div_ch2 = *self->cp_tempo_div_ch2;
-        *self->cp_tempo_out = cur_tempo;
+/**
+* Points the delay time smoothers at their targets. In jump mode, they are
+* set to the new delay times right away instead, while the heads at the old
+* delay times fade out. Changes during a crossfade wait for it to end.
+* \param self pointer to current plugin instance.
+* \param ctl control values of this run
+*/
+static void set_delay_targets(BollieDelayXT* self, const BollieCtl* ctl) {
+    if (!ctl->cp_delay_jump) {
+        for (uint32_t c = 0 ; c < self->channels ; ++c)
+            bsm_set(&self->sm_d_t[c], self->tgt_d_t[c]);
+        return;
     }
+    if (self->jump_pos < self->jump_length)
+        return;
 
-    // Gain handling
-    
-    if (*self->cp_gain_dry != self->cur_cp_gain_dry) {
-        if (*self->cp_gain_dry > 12.f) {
-            tgt_gain_dry = 4.f;
-        }
-        else if (*self->cp_gain_dry < -96.f) {
-            tgt_gain_dry = 0;
-        }
-        else {
-            tgt_gain_dry = powf(10, (*self->cp_gain_dry/20));
-        }
-        self->cur_cp_gain_dry = *self->cp_gain_dry;
-    } 
-    
-    if (*self->cp_gain_wet != self->cur_cp_gain_wet) {
-        if (*self->cp_gain_wet > 12.f) {
-            tgt_gain_wet = 4.f;
-        }
-        else if (*self->cp_gain_wet < -96.f) {
-            tgt_gain_wet = 0;
-        }
-        else {
-            tgt_gain_wet = powf(10, (*self->cp_gain_wet/20));
-        }
-        self->cur_cp_gain_wet = *self->cp_gain_wet;
-    } 
-    
-    // Feedback
-    if (!cp_ping_pong) {
-        if (*self->cp_fb != self->cur_cp_fb) {
-            if (*self->cp_fb > 99.f ) {
-                tgt_fb = 1.f;
-            }
-            else if (*self->cp_fb < 0) {
-                tgt_fb = 0;
-            }
-            else {
-                tgt_fb = *self->cp_fb / 100;
-            }
-            self->cur_cp_fb = *self->cp_fb;
-        }
-    } 
-    else {
-        // ping pong mode. We don't want any FB here
-        tgt_fb = 0;
+    bool changed = false;
+    for (uint32_t c = 0 ; c < self->channels ; ++c) {
+        changed = changed || self->sm_d_t[c].tgt != self->tgt_d_t[c]
+            || !self->sm_d_t[c].settled;
     }
-    
-    // Crossfeed
-    if (*self->cp_cf != self->cur_cp_cf) {
-        if (*self->cp_cf > 99.f) {
-            tgt_cf = 1.f;
-        }
-        else if (*self->cp_cf < 0) {
-            tgt_cf = 0;
-        }
-        else {
-            tgt_cf = *self->cp_cf / 100;
-        }
-        self->cur_cp_cf = *self->cp_cf;
-    } 
+    if (!changed)
+        return;
 
-    // Modulation
-    if (cp_mod_depth < 0.1f || cp_mod_depth > MOD_OFFSET_MS)
-        cp_mod_depth = 2.f;
+    for (uint32_t c = 0 ; c < self->channels ; ++c) {
+        self->jump_from[c] = self->sm_d_t[c].cur;
+        bsm_reset(&self->sm_d_t[c], self->tgt_d_t[c]);
+    }
 
-    if (cp_mod_rate < 0.1f || cp_mod_rate > 2.f)
-        cp_mod_rate = 0.1f;
+    // Nothing is read while filling the delay lines, no need to fade
+    if (self->state != FILL_BUF)
+        self->jump_pos = 0;
+}
 
-    // User disabled the plugin, fade out
-    if (!cp_enabled && state != FADE_OUT_DONE && !cp_trails)
-        state = FADE_OUT;
 
-    // Loop over the block of audio we got
-    for (uint32_t i = 0 ; i < n_samples ; ++i) {
+/**
+* Computes the gains of the old and the new read heads for the next n
+* samples of a delay jump. They follow a quarter cosine and sine, so the
+* power stays constant. The sine is stepped by rotation, starting from where
+* the crossfade is at.
+* \param self pointer to current plugin instance.
+* \param n number of samples
+* \return true, if a crossfade is running
+*/
+static bool jump_gains(BollieDelayXT* self, uint32_t n) {
+    if (self->jump_pos >= self->jump_length)
+        return false;
+
+    float *g_old = self->blk_jump[0];
+    float *g_new = self->blk_jump[1];
+    const float step = (float)M_PI_2 / self->jump_length;
+    const float rc = cosf(step);
+    const float rs = sinf(step);
+    float c = cosf(step * self->jump_pos);
+    float s = sinf(step * self->jump_pos);
+    uint32_t m = self->jump_length - self->jump_pos;
+    if (m > n)
+        m = n;
+    for (uint32_t i = 0 ; i < m ; ++i) {
+        float t = c * rc - s * rs;
+        s = s * rc + c * rs;
+        c = t;
+        g_old[i] = c;
+        g_new[i] = s;
+    }
+    for (uint32_t i = m ; i < n ; ++i) {
+        g_old[i] = 0;
+        g_new[i] = 1.f;
+    }
+    return true;
+}
 
-        /* Shortcut here, if the user has disabled the plugin
-           This is not relevant for trail mode*/
-        if (state == FADE_OUT_DONE) {
-            if (!cp_enabled) {
-                cur_gain_dry = 0.01f + cur_gain_dry * 0.99f;
-                self->output_ch1[i] = self->input_ch1[i] * cur_gain_dry;
-                self->output_ch2[i] = self->input_ch2[i] * cur_gain_dry;
-                continue;
-            }
-            else {
-                pos_w = 0;
-                state = FILL_BUF;
-            }
-        }
 
-        // Parameter smoothing
-        cur_gain_buf_in = (!cp_enabled && cp_trails ? 0 : 0.01f) 
-            + cur_gain_buf_in * 0.99f;
-        cur_gain_dry = tgt_gain_dry * 0.01f + cur_gain_dry * 0.99f;
-        cur_gain_wet = tgt_gain_wet * 0.01f + cur_gain_wet * 0.99f;
-        cur_cf = tgt_cf * 0.01f + cur_cf * 0.99f;
-        cur_fb = tgt_fb * 0.01f + cur_fb * 0.99f;
-        cur_mod_depth = (cp_mod_on ? cp_mod_depth : 0) * 0.01f 
-            + cur_mod_depth * 0.99f;
-
-        cur_d_t_ch1 = tgt_d_t_ch1 * 0.001f + cur_d_t_ch1 * 0.999f;
-        cur_d_t_ch2 = tgt_d_t_ch2 * 0.001f + cur_d_t_ch2 * 0.999f;
-
-        // Keep the LFO running
-        float lfo_offset_ch1 = 0;
-        float lfo_offset_ch2 = 0;
-        if (cur_mod_depth > 0) {
-            float lfo_coeff = sinf(lfo_curphase);
-            if (cp_mod_rate != cur_mod_rate) {
-                cur_mod_rate = cp_mod_rate;
-                lfo_incr = self->lfo_circle * cur_mod_rate;
-            }
-            lfo_curphase += lfo_incr;
+/**
+* Advances a running crossfade of a delay jump. Once it's done, the allpass
+* interpolators pick up at the new delay times.
+* \param self pointer to current plugin instance.
+* \param ctl control values of this run
+* \param n number of samples processed
+*/
+static void jump_advance(BollieDelayXT* self, const BollieCtl* ctl,
+    uint32_t n) {
+    if (self->jump_pos >= self->jump_length)
+        return;
+
+    self->jump_pos += n;
+    if (self->jump_pos < self->jump_length)
+        return;
+
+    self->jump_pos = self->jump_length;
+    if (ctl->interp == BI_ALLPASS) {
+        for (uint32_t c = 0 ; c < self->channels ; ++c)
+            bi_allpass_prime(&self->ap[c], self->buffer[c], self->buf_size,
+                (double)self->pos_w - self->sm_d_t[c].cur);
+    }
+}
 
-            // A chance to do desired phase switching
-            if (lfo_curphase >= TWO_PI) {
-                cur_mod_phase = cp_mod_phase;
-                lfo_curphase -= TWO_PI;
-            }
-            else if (lfo_curphase < 0.0f) {
-                cur_mod_phase = cp_mod_phase;
-                lfo_curphase += TWO_PI;
-            }
 
-            // Calculate offset for ch1
-            lfo_offset_ch1 = (cur_mod_depth / 1000 * rate) * lfo_coeff;
+/**
+* Points the parameter smoothers at the targets of this run.
+* \param self pointer to current plugin instance.
+* \param ctl control values of this run
+*/
+static void set_targets(BollieDelayXT* self, const BollieCtl* ctl) {
+    bsm_set(&self->sm_gain_buf_in,
+        !ctl->cp_enabled && ctl->cp_trails ? 0 : 1.f);
+    bsm_set(&self->sm_gain_dry, self->tgt_gain_dry);
+    bsm_set(&self->sm_gain_wet, self->tgt_gain_wet);
+    bsm_set(&self->sm_cf, self->tgt_cf);
+    bsm_set(&self->sm_fb, self->tgt_fb);
+    bsm_set(&self->sm_mod_depth, ctl->cp_mod_on ? ctl->cp_mod_depth : 0);
+    set_delay_targets(self, ctl);
+}
 
-            // In case the user desires a phase switch, then turn the ch2 by
-            // 180 degrees
-            lfo_offset_ch2 = 
-                cur_mod_phase ? lfo_offset_ch1 * -1 : lfo_offset_ch1;
-        }
-        else {
-            lfo_curphase = 0.0f;
-        }
 
-        // Store old samples here
-        float old_s_ch1 = 0;
-        float old_s_ch2 = 0;
+/**
+* Distance of the main read heads. They read ahead by the lookahead of the
+* limiter, which delays the signal by as much again. Short delays, while
+* the delay time is still gliding up, only read ahead by half of theirs.
+* \param d delay time in samples
+* \param la lookahead in samples
+* \return read distance in samples
+*/
+static inline float read_distance(float d, float la) {
+    return d - fminf(la, 0.5f * d);
+}
 
-        // Current samples
-        float cur_s_ch1 = self->input_ch1[i];
-        float cur_s_ch2 = self->input_ch2[i];
 
-        // Gain coefficient used while fading
-        float fade_coeff = 0;
+/**
+* Checks, whether the next n samples can be run through the block pipeline.
+* This is the case in the CYCLE state, if none of the reads depend on
+* samples written within the same block.
+* \param self pointer to current plugin instance.
+* \param ctl control values of this run
+* \param n number of samples in the block
+* \return true, if run_block() can be used
+*/
+static bool block_path_ok(const BollieDelayXT* self, const BollieCtl* ctl,
+    uint32_t n) {
+    if (self->state != CYCLE)
+        return false;
+
+    float depth = fmaxf(self->sm_mod_depth.cur,
+        ctl->cp_mod_on ? ctl->cp_mod_depth : 0) / 1000 * self->sample_rate;
+    float d = INFINITY;
+    for (uint32_t c = 0 ; c < self->channels ; ++c) {
+        d = fminf(d, read_distance(fminf(self->sm_d_t[c].cur,
+            self->tgt_d_t[c]), self->limiter.la));
+        if (self->jump_pos < self->jump_length)
+            d = fminf(d, read_distance(self->jump_from[c], self->limiter.la));
+        d = fminf(d, bt_shortest(&self->taps[c]));
+    }
 
-        if (state == FADE_OUT) {
-            if (fade_pos > 0) { 
-               fade_coeff = --fade_pos * (1/(float)fade_length); 
-            }
-            else {
-                state = FADE_OUT_DONE;
-            }
-        }
-        else if (state == FILL_BUF) {
-            // Change to state fade in, when the buffer is full enough
-            if ((double)pos_w > cur_d_t_ch1 + self->mod_offset_samples
-                && (double)pos_w > cur_d_t_ch2 + self->mod_offset_samples) {
-                state = FADE_IN;
-            }
-        }
+    return d - depth > (float)(n + BUF_GUARD);
+}
+
+
+/**
+* Upper bound of the gain of a feedback filter at its resonance.
+* \param Q filter quality
+* \return peak gain
+*/
+static float fb_filter_gain(float Q) {
+    return Q > (float)M_SQRT1_2 ? Q / sqrtf(1.f - 0.25f / (Q * Q)) : 1.f;
+}
+
+
+/**
+* Checks, whether the instance may go idle. That's the case, if nothing
+* audible has been written to the delay lines for longer than any read
+* reaches back and the feedback loop can't grow what's left in there.
+* \param self pointer to current plugin instance.
+* \param ctl control values of this run
+* \return true, if silent input can be handled by run_idle()
+*/
+static bool idle_ok(const BollieDelayXT* self, const BollieCtl* ctl) {
+    if (self->state != CYCLE && self->state != FILL_BUF)
+        return false;
+
+    float reach = 0;
+    float taps_loop = 0;
+    for (uint32_t c = 0 ; c < self->channels ; ++c) {
+        reach = fmaxf(reach, fmaxf(self->sm_d_t[c].cur, self->tgt_d_t[c]));
+        if (self->jump_pos < self->jump_length)
+            reach = fmaxf(reach, self->jump_from[c]);
+        reach = fmaxf(reach, bt_longest(&self->taps[c]));
+        taps_loop = fmaxf(taps_loop, bt_loop_gain(&self->taps[c]));
+    }
+    reach += self->mod_offset_samples + BUF_GUARD;
+    if ((float)self->quiet_count <= reach)
+        return false;
+
+    float loop = fmaxf(self->sm_fb.cur, self->tgt_fb) + taps_loop
+        + fmaxf(self->sm_cf.cur, self->tgt_cf);
+    if (ctl->cp_hcf_fb_on)
+        loop *= fb_filter_gain(ctl->cp_hcf_fb_q);
+    if (ctl->cp_lcf_fb_on)
+        loop *= fb_filter_gain(ctl->cp_lcf_fb_q);
+
+    return loop < 1.f;
+}
+
+
+/**
+* Counts the silent samples at the start of a block of input.
+* \param self pointer to current plugin instance.
+* \param offset offset of the block within the port buffers
+* \param n number of samples
+* \return number of samples before the first one, that isn't silent
+*/
+static uint32_t quiet_len(const BollieDelayXT* self, uint32_t offset,
+    uint32_t n) {
+    for (uint32_t c = 0 ; c < self->channels ; ++c) {
+        const float *in = self->input[c] + offset;
+        for (uint32_t i = 0 ; i < n ; ++i) {
+            if (fabsf(in[i]) >= IDLE_LEVEL) {
+                n = i;
+                break;
+            }
+        }
+    }
+    return n;
+}
+
+
+/**
+* Checks, whether an output shares its buffer with the input of another
+* channel. Such channels have to be read frame by frame, before anything is
+* written.
+* \param self pointer to current plugin instance.
+* \return true, if the channels cross over in the host's buffers
+*/
+static bool ports_crossed(const BollieDelayXT* self) {
+    for (uint32_t c = 0 ; c < self->channels ; ++c) {
+        for (uint32_t j = 0 ; j < self->channels ; ++j) {
+            if (j != c && (const float*)self->output[c] == self->input[j])
+                return true;
+        }
+    }
+    return false;
+}
+
+
+/**
+* Writes the input scaled by a gain curve to the outputs.
+* \param self pointer to current plugin instance.
+* \param offset offset of the block within the port buffers
+* \param gain gain per sample
+* \param n number of samples in this block, not more than BLOCK_SIZE
+*/
+static void mix_dry(BollieDelayXT* self, uint32_t offset, const float *gain,
+    uint32_t n) {
+    uint32_t channels = self->channels;
+
+    if (self->crossed) {
+        // Channels cross over in the host's buffers, read all of them first
+        for (uint32_t i = 0 ; i < n ; ++i) {
+            float s[MAX_CHANNELS];
+            for (uint32_t c = 0 ; c < channels ; ++c)
+                s[c] = self->input[c][offset + i];
+            for (uint32_t c = 0 ; c < channels ; ++c)
+                self->output[c][offset + i] = s[c] * gain[i];
+        }
+        return;
+    }
+
+    for (uint32_t c = 0 ; c < channels ; ++c) {
+        const float *in = self->input[c] + offset;
+        float *out = self->output[c] + offset;
+        for (uint32_t i = 0 ; i < n ; ++i)
+            out[i] = in[i] * gain[i];
+    }
+}
+
+
+/**
+* Processes silent input while the delay lines hold nothing audible. Only
+* zeros are written to the delay lines and the output is the dry signal.
+* Smoothers skip ahead to where they would be after the block.
+* \param self pointer to current plugin instance.
+* \param ctl control values of this run
+* \param offset offset of the block within the port buffers
+* \param n number of samples in this block, not more than BLOCK_SIZE
+*/
+static void run_idle(BollieDelayXT* self, const BollieCtl* ctl,
+    uint32_t offset, uint32_t n) {
+
+    set_targets(self, ctl);
+    mix_dry(self, offset, bsm_block(&self->sm_gain_dry, n), n);
+
+    clear_range(self, self->pos_w, n);
+
+    float pf = self->pow_fast[n-1];
+    float ps = self->pow_slow[n-1];
+    bsm_skip(&self->sm_gain_buf_in, n);
+    bsm_skip(&self->sm_gain_wet, n);
+    bsm_skip(&self->sm_cf, n);
+    bsm_skip(&self->sm_fb, n);
+    bsm_skip(&self->sm_mod_depth, n);
+    for (uint32_t c = 0 ; c < self->channels ; ++c) {
+        bsm_skip(&self->sm_d_t[c], n);
+        bt_skip(&self->taps[c], pf, ps);
+
+        // Nothing but zeros left to read
+        self->ap[c].x1 = self->ap[c].y1 = 0;
+    }
+    blm_reset(&self->limiter);
+
+    if (self->quiet_count < self->buf_size)
+        self->quiet_count += n;
+    self->pos_w = (self->pos_w + (int32_t)n) & self->buf_mask;
+    jump_advance(self, ctl, n);
+}
+
+
+/**
+* Passes the input through, once the plugin has been disabled and the delay
+* has faded out. The dry gain glides to unity first, then the block is a
+* plain copy, or nothing at all when processing in place.
+* \param self pointer to current plugin instance.
+* \param offset offset of the block within the port buffers
+* \param n number of samples in this block, not more than BLOCK_SIZE
+*/
+static void run_bypass(BollieDelayXT* self, uint32_t offset, uint32_t n) {
+    uint32_t channels = self->channels;
+
+    bsm_set(&self->sm_gain_dry, 1.f);
+    if (!self->sm_gain_dry.settled) {
+        mix_dry(self, offset, bsm_block(&self->sm_gain_dry, n), n);
+    }
+    else if (self->crossed) {
+        // Channels cross over in the host's buffers, read all of them first
+        for (uint32_t i = offset ; i < offset + n ; ++i) {
+            float s[MAX_CHANNELS];
+            for (uint32_t c = 0 ; c < channels ; ++c)
+                s[c] = self->input[c][i];
+            for (uint32_t c = 0 ; c < channels ; ++c)
+                self->output[c][i] = s[c];
+        }
+    }
+    else {
+        for (uint32_t c = 0 ; c < channels ; ++c) {
+            if (self->output[c] != self->input[c])
+                memmove(self->output[c] + offset, self->input[c] + offset,
+                    n * sizeof(float));
+        }
+    }
+}
+
+
+/**
+* Processes a block sample by sample. Used for all states and for delay
+* times shorter than the block. All channels of a frame are kept in arrays
+* padded to the filter bank width, so the arithmetic on them compiles to
+* vector operations.
+* \param self pointer to current plugin instance.
+* \param ctl control values of this run
+* \param offset offset of the block within the port buffers
+* \param n_samples number of samples in this block
+* \return number of samples processed, less than n_samples if the delay
+*         faded out while enabled again and has to start over
+*/
+static uint32_t run_samples(BollieDelayXT* self, const BollieCtl* ctl,
+    uint32_t offset, uint32_t n_samples) {
+
+    // Parameter smoothing, the whole block at once
+    const uint32_t channels = self->channels;
+    const float gain_dry_0 = self->sm_gain_dry.cur;
+    set_targets(self, ctl);
+    const float *gain_buf_in = bsm_block(&self->sm_gain_buf_in, n_samples);
+    const float *gain_dry = bsm_block(&self->sm_gain_dry, n_samples);
+    const float *gain_wet = bsm_block(&self->sm_gain_wet, n_samples);
+    const float *cf = bsm_block(&self->sm_cf, n_samples);
+    const float *fb = bsm_block(&self->sm_fb, n_samples);
+    const float *mod_depth = bsm_block(&self->sm_mod_depth, n_samples);
+    const float *d_t[MAX_CHANNELS];
+    for (uint32_t c = 0 ; c < channels ; ++c)
+        d_t[c] = bsm_block(&self->sm_d_t[c], n_samples);
+
+    // A delay jump reads at the old delay times as well
+    const bool jump = jump_gains(self, n_samples);
+    const float *jump_old = self->blk_jump[0];
+    const float *jump_new = self->blk_jump[1];
+
+    // Copy variables from heap to stack to speed up looping over the samples
+    float cp_enabled = ctl->cp_enabled;
+    float cp_ping_pong = ctl->cp_ping_pong;
+    float cp_hcf_fb_on = ctl->cp_hcf_fb_on;
+    float cp_lcf_fb_on = ctl->cp_lcf_fb_on;
+    float cp_hcf_pre_on = ctl->cp_hcf_pre_on;
+    float cp_lcf_pre_on = ctl->cp_lcf_pre_on;
+    BollieInterp interp = jump && ctl->interp == BI_ALLPASS ?
+        BI_HERMITE : ctl->interp;
+    bool taps_on = false;
+    int32_t fade_pos = self->fade_pos;
+    int32_t fade_length = self->fade_length;
+    float ms_to_samples = self->ms_to_samples;
+    float mod_rot_c = ctl->mod_rot_c;
+    float mod_rot_s = ctl->mod_rot_s;
+    int32_t pos_w = self->pos_w;
+    int32_t buf_size = self->buf_size;
+    int32_t buf_mask = self->buf_mask;
+    BollieState state = self->state;
+    uint32_t stop = n_samples;
+    const float (*xfeed)[BF_CHANNELS] = self->xfeed[cp_ping_pong ? 1 : 0];
+    float pp_in = self->pp_in;
+    bool lfo_ticked = false;
+
+    BollieLimiter *limiter = &self->limiter;
+    const float la = limiter->la;
+
+    const float pf = self->pow_fast[0];
+    const float ps = self->pow_slow[0];
+    uint32_t tap_lo[MAX_CHANNELS];
+    uint32_t tap_hi[MAX_CHANNELS];
+    for (uint32_t c = 0 ; c < channels ; ++c) {
+        int p = self->layout->pair[c] < 0 ? (int)c : self->layout->pair[c];
+        tap_lo[c] = p < (int)c ? p : (int)c;
+        tap_hi[c] = p > (int)c ? p : (int)c;
+        taps_on = taps_on || self->taps[c].active;
+    }
+
+    const float *input[MAX_CHANNELS];
+    float *output[MAX_CHANNELS];
+    for (uint32_t c = 0 ; c < channels ; ++c) {
+        input[c] = self->input[c] + offset;
+        output[c] = self->output[c] + offset;
+    }
+
+    // Loop over the block of audio we got
+    for (uint32_t i = 0 ; i < n_samples ; ++i) {
+
+        // Current samples, all read before anything is written
+        float cur_s[BF_CHANNELS] = {0};
+        for (uint32_t c = 0 ; c < channels ; ++c)
+            cur_s[c] = input[c][i];
+
+        /* Shortcut here, if the user has disabled the plugin, the rest of
+           the block is bypassed. This is not relevant for trail mode. If
+           it has been enabled again, process() starts over from here. */
+        if (state == FADE_OUT_DONE) {
+            stop = i;
+            break;
+        }
+
+        const float cur_gain_buf_in = gain_buf_in[i];
+        const float cur_gain_dry = gain_dry[i];
+        const float cur_gain_wet = gain_wet[i];
+        const float cur_cf = cf[i];
+        const float cur_fb = fb[i];
+
+        // Keep the LFO running, even and odd channels get their own offset
+        float lfo_offset[2] = { 0, 0 };
+        if (mod_depth[i] > 0) {
+            float v, q;
+            bl_tick(&self->lfo, &v, &q);
+            lfo_ticked = true;
+
+            // Calculate offset for even channels
+            float depth = mod_depth[i] * ms_to_samples;
+            lfo_offset[0] = depth * v;
+
+            /* Odd channels are rotated by the phase offset, using the
+               quadrature output */
+            lfo_offset[1] = depth * (v * mod_rot_c + q * mod_rot_s);
+        }
+
+        // Store old samples here
+        float old_s[BF_CHANNELS] = {0};
+
+        // Gain coefficient used while fading
+        float fade_coeff = 0;
+
+        if (state == FADE_OUT) {
+            if (fade_pos > 0) {
+               fade_coeff = --fade_pos * (1/(float)fade_length);
+            }
+            else {
+                state = FADE_OUT_DONE;
+            }
+        }
+        else if (state == FILL_BUF) {
+            // Change to state fade in, when the buffer is full enough
+            bool full = true;
+            for (uint32_t c = 0 ; c < channels ; ++c)
+                full = full && (double)pos_w
+                    > d_t[c][i] + self->mod_offset_samples;
+            if (full)
+                state = FADE_IN;
+        }
         else if (state == FADE_IN) {
             if (fade_pos < fade_length) {
                 // Keep fading
@@ -713,118 +1447,1361 @@ static void run(LV2_Handle instance, uint32_t n_samples) {
 
         // In this states, we'll retrieve old samples, interpolate if needed
         if (state == FADE_IN || state == FADE_OUT || state == CYCLE) {
-            // Channel 1
-            double x = (double)pos_w - cur_d_t_ch1 + lfo_offset_ch1; 
-            old_s_ch1 = interpolate(self->buffer_ch1, x) * fade_coeff;
-
-            // Channel 2
-            x = (double)pos_w - cur_d_t_ch2 + lfo_offset_ch2; 
-            old_s_ch2 = interpolate(self->buffer_ch2, x) * fade_coeff;
+            for (uint32_t c = 0 ; c < channels ; ++c) {
+                double x = (double)pos_w - read_distance(d_t[c][i], la)
+                    + lfo_offset[c & 1];
+                old_s[c] = bi_read(interp, self->buffer[c], buf_size, x,
+                    &self->ap[c]);
+                if (jump) {
+                    double y = (double)pos_w
+                        - read_distance(self->jump_from[c], la)
+                        + lfo_offset[c & 1];
+                    old_s[c] = old_s[c] * jump_new[i]
+                        + bi_read(interp, self->buffer[c], buf_size, y,
+                        &self->ap[c]) * jump_old[i];
+                }
+                old_s[c] *= fade_coeff;
+            }
 
             /* Limiting happening after retrieval from buffer to safe from
             modulation going bonkers */
-            float v = fabs(old_s_ch1);
-            lim_envelope_ch1 = (v > lim_envelope_ch1 ? lim_attack : lim_release)
-                * (lim_envelope_ch1 - v) + v;
-            if (lim_envelope_ch1 > 1.f) old_s_ch1 /= lim_envelope_ch1;
-
-            v = fabs(old_s_ch2);
-            lim_envelope_ch2 = (v > lim_envelope_ch2 ? lim_attack : lim_release)
-                * (lim_envelope_ch2 - v) + v;
-            if (lim_envelope_ch1 > 1.f) old_s_ch2 /= lim_envelope_ch2;
+            blm_process_frame(limiter, old_s);
 
             // High cut filter on feedback
-            if (cp_hcf_fb_on) {
-                old_s_ch1 = bf_hcf(old_s_ch1, cp_hcf_fb_freq, cp_hcf_fb_q, rate,
-                    &self->fil_hcf_fb_ch1);
-                old_s_ch2 = bf_hcf(old_s_ch2, cp_hcf_fb_freq, cp_hcf_fb_q, rate,
-                    &self->fil_hcf_fb_ch2);
-            }
+            if (cp_hcf_fb_on)
+                bfb_process_frame(&self->fil_hcf_fb, old_s, channels);
 
             // Low cut filter on feedback
-            if (cp_lcf_fb_on) {
-                old_s_ch1 = bf_lcf(old_s_ch1, cp_lcf_fb_freq, cp_lcf_fb_q, rate,
-                    &self->fil_lcf_fb_ch1);
-                old_s_ch2 = bf_lcf(old_s_ch2, cp_lcf_fb_freq, cp_lcf_fb_q, rate,
-                    &self->fil_lcf_fb_ch2);
-            }
-        }
+            if (cp_lcf_fb_on)
+                bfb_process_frame(&self->fil_lcf_fb, old_s, channels);
 
-        /* Filtering before feedback loop */
-        float cur_fil_s_ch1 = cur_s_ch1; // current filtered sample
-        float cur_fil_s_ch2 = cur_s_ch2;
-        if (cp_hcf_pre_on) {
-            cur_fil_s_ch1 = bf_hcf(cur_fil_s_ch1, cp_hcf_pre_freq, cp_hcf_pre_q,
-                rate, &self->fil_hcf_pre_ch1);
-            cur_fil_s_ch2 = bf_hcf(cur_fil_s_ch2, cp_hcf_pre_freq, cp_hcf_pre_q,
-                rate, &self->fil_hcf_pre_ch2);
+            // Let decayed tails end in zeros instead of denormals
+            for (uint32_t c = 0 ; c < BF_CHANNELS ; ++c)
+                old_s[c] = bdn_flush(old_s[c]);
         }
 
-        if (cp_lcf_pre_on) {
-            cur_fil_s_ch1 = bf_lcf(cur_fil_s_ch1, cp_lcf_pre_freq, cp_lcf_pre_q,
-                rate, &self->fil_lcf_pre_ch1);
-            cur_fil_s_ch2 = bf_lcf(cur_fil_s_ch2, cp_lcf_pre_freq, cp_lcf_pre_q,
-                rate, &self->fil_lcf_pre_ch2);
+        // Additional read heads, they fade along with the main ones
+        float tap_s[BF_CHANNELS] = {0};
+        float tap_fb[BF_CHANNELS] = {0};
+        if (taps_on) {
+            for (uint32_t c = 0 ; c < channels ; ++c) {
+                float l, r;
+                bt_process(&self->taps[c], interp, self->buffer[c], buf_size,
+                    (double)pos_w + lfo_offset[c & 1], pf, ps, &l, &r,
+                    &tap_fb[c]);
+                tap_s[tap_lo[c]] += l;
+                tap_s[tap_hi[c]] += r;
+            }
+            for (uint32_t c = 0 ; c < BF_CHANNELS ; ++c) {
+                tap_s[c] *= fade_coeff;
+                tap_fb[c] *= fade_coeff;
+            }
         }
 
-        /* Summing for the delay lines */
+        /* Filtering before feedback loop */
+        float cur_fil_s[BF_CHANNELS]; // current filtered samples
+        memcpy(cur_fil_s, cur_s, sizeof(cur_fil_s));
+        if (cp_hcf_pre_on)
+            bfb_process_frame(&self->fil_hcf_pre, cur_fil_s, channels);
+
+        if (cp_lcf_pre_on)
+            bfb_process_frame(&self->fil_lcf_pre, cur_fil_s, channels);
+
+        /* Summing for the delay lines, feedback and crossfeed first, then
+        the input */
+        float buf_s[BF_CHANNELS];
+        float fb_s = cp_ping_pong ? 0 : cur_fb;
+        for (uint32_t c = 0 ; c < BF_CHANNELS ; ++c)
+            buf_s[c] = old_s[c] * fb_s;
+        for (uint32_t j = 0 ; j < channels ; ++j) {
+            for (uint32_t c = 0 ; c < BF_CHANNELS ; ++c)
+                buf_s[c] += xfeed[j][c] * old_s[j] * cur_cf;
+        }
         if (cp_ping_pong) {
-            /* In ping pong mode, we sum both input channels with -6 dBFS
-            and send them solely to the buffer for the first channel.
-            cur_cf-coeff takes care of the spill-over*/
-            self->buffer_ch1[pos_w] = cur_gain_buf_in 
-                * (cur_fil_s_ch1 * 0.5f + cur_fil_s_ch2 * 0.5f)
-                + old_s_ch2 * cur_cf
-            ;
-            self->buffer_ch2[pos_w] = old_s_ch1 * cur_cf;
+            /* In ping pong mode, we sum all input channels and send them
+            solely to the buffer for the first channel. cur_cf-coeff takes
+            care of the spill-over*/
+            float sum = 0;
+            for (uint32_t c = 0 ; c < channels ; ++c)
+                sum += cur_fil_s[c] * pp_in;
+            buf_s[0] += cur_gain_buf_in * sum;
         }
         else {
             // Normal mode
-            self->buffer_ch1[pos_w] = cur_gain_buf_in * cur_fil_s_ch1 
-                + old_s_ch1 * cur_fb
-                + old_s_ch2 * cur_cf
-            ;
-
-            self->buffer_ch2[pos_w] = cur_gain_buf_in * cur_fil_s_ch2
-                + old_s_ch2 * cur_fb
-                + old_s_ch1 * cur_cf
-            ;
+            for (uint32_t c = 0 ; c < BF_CHANNELS ; ++c)
+                buf_s[c] += cur_gain_buf_in * cur_fil_s[c];
         }
+        if (taps_on) {
+            for (uint32_t c = 0 ; c < BF_CHANNELS ; ++c)
+                buf_s[c] += tap_fb[c];
+        }
+        for (uint32_t c = 0 ; c < channels ; ++c)
+            write_sample(self->buffer[c], buf_size, pos_w, buf_s[c]);
 
         // Final summing
-        self->output_ch1[i] = cur_s_ch1 * cur_gain_dry 
-            + old_s_ch1 * cur_gain_wet;
-        self->output_ch2[i] = cur_s_ch2 * cur_gain_dry 
-            + old_s_ch2 * cur_gain_wet;
+        float out_s[BF_CHANNELS];
+        for (uint32_t c = 0 ; c < BF_CHANNELS ; ++c)
+            out_s[c] = cur_s[c] * cur_gain_dry + old_s[c] * cur_gain_wet;
+        if (taps_on) {
+            for (uint32_t c = 0 ; c < BF_CHANNELS ; ++c)
+                out_s[c] += tap_s[c] * cur_gain_wet;
+        }
+        for (uint32_t c = 0 ; c < channels ; ++c)
+            output[c][i] = out_s[c];
 
         // Increase write index, wrap around if needed
-        pos_w = pos_w + 1 >= MAX_BUF_SIZE ? 0 : pos_w + 1;
+        pos_w = (pos_w + 1) & buf_mask;
     }
 
     // Copy state variables back to heap for next run
-    self->cur_d_t_ch1 = cur_d_t_ch1;
-    self->cur_d_t_ch2 = cur_d_t_ch2;
-    self->cur_fb = cur_fb;
-    self->cur_cf = cur_cf;
-    self->cur_gain_buf_in = cur_gain_buf_in;
-    self->cur_gain_dry = cur_gain_dry;
-    self->cur_gain_wet = cur_gain_wet;
-    self->cur_mod_depth = cur_mod_depth;
-    self->cur_mod_rate = cur_mod_rate;
-    self->cur_mod_phase = cur_mod_phase;
     self->fade_pos = fade_pos;
-    self->lfo_curphase = lfo_curphase;
-    self->lfo_incr = lfo_incr;
     self->pos_w = pos_w;
     self->state = state;
-    self->tgt_d_t_ch1 = tgt_d_t_ch1;
-    self->tgt_d_t_ch2 = tgt_d_t_ch2;
-    self->tgt_gain_dry = tgt_gain_dry;
-    self->tgt_gain_wet = tgt_gain_wet;
-    self->tgt_cf = tgt_cf;
-    self->tgt_fb = tgt_fb;
-    self->lim_envelope_ch1 = lim_envelope_ch1;
-    self->lim_envelope_ch2 = lim_envelope_ch2;
+    jump_advance(self, ctl, stop);
+
+    // The block path renormalizes the LFO, this one has to as well
+    if (lfo_ticked)
+        bl_renormalize(&self->lfo);
+
+    if (stop == n_samples)
+        return n_samples;
+
+    // Faded out, the dry gain glides on from where it got to
+    bsm_hold(&self->sm_gain_dry, stop ? gain_dry[stop - 1] : gain_dry_0);
+    if (!cp_enabled) {
+        run_bypass(self, offset + stop, n_samples - stop);
+        return n_samples;
+    }
+
+    // Enabled again, the other glides go on from there as well
+    if (stop) {
+        bsm_hold(&self->sm_gain_buf_in, gain_buf_in[stop - 1]);
+        bsm_hold(&self->sm_gain_wet, gain_wet[stop - 1]);
+        bsm_hold(&self->sm_cf, cf[stop - 1]);
+        bsm_hold(&self->sm_fb, fb[stop - 1]);
+        bsm_hold(&self->sm_mod_depth, mod_depth[stop - 1]);
+        for (uint32_t c = 0 ; c < channels ; ++c)
+            bsm_hold(&self->sm_d_t[c], d_t[c][stop - 1]);
+    }
+    return stop;
+}
+
+
+/**
+* Reads a block at the old delay time of a channel during a delay jump and
+* crossfades it with the block read at the new one.
+* \param self pointer to current plugin instance.
+* \param q interpolation kernel
+* \param c channel
+* \param pos_w write position of the first sample
+* \param out samples read at the new delay time, crossfaded in place
+* \param n number of samples in this block, not more than BLOCK_SIZE
+*/
+static void read_jump(BollieDelayXT* self, BollieInterp q, uint32_t c,
+    int32_t pos_w, float* out, uint32_t n) {
+    const float *g_old = self->blk_jump[0];
+    const float *g_new = self->blk_jump[1];
+    float *old = self->blk_jump_old;
+    float *d = self->blk_read;
+
+    const float from = read_distance(self->jump_from[c], self->limiter.la);
+    for (uint32_t i = 0 ; i < n ; ++i)
+        d[i] = from;
+    bi_gather(q, self->buffer[c], self->buf_size, pos_w, d,
+        self->blk_lfo[c & 1], old, n, &self->ap[c]);
+
+    for (uint32_t i = 0 ; i < n ; ++i)
+        out[i] = out[i] * g_new[i] + old[i] * g_old[i];
+}
+
+
+/**
+* Advances the smoothers by a block, except for the modulation depth, which
+* is only needed with the LFO running. The ramps are left in the smoothers.
+* Kept out of line, so the CYCLE kernels share it.
+* \param self pointer to current plugin instance.
+* \param ctl control values of this run
+* \param n number of samples in this block, not more than BLOCK_SIZE
+*/
+static __attribute__((noinline)) void smooth_block(BollieDelayXT* self,
+    const BollieCtl* ctl, uint32_t n) {
+    set_targets(self, ctl);
+    bsm_block(&self->sm_gain_buf_in, n);
+    bsm_block(&self->sm_gain_dry, n);
+    bsm_block(&self->sm_gain_wet, n);
+    bsm_block(&self->sm_cf, n);
+    bsm_block(&self->sm_fb, n);
+    for (uint32_t c = 0 ; c < self->channels ; ++c)
+        bsm_block(&self->sm_d_t[c], n);
+}
+
+
+/**
+* Reads the delay lines and the taps of a block, at the delay times the
+* smoothers have ramped for it. None of the reads reach into this block.
+* \param self pointer to current plugin instance.
+* \param ctl control values of this run
+* \param mod the LFO offsets in blk_lfo are in use
+* \param taps_on any line has active taps
+* \param n number of samples in this block, not more than BLOCK_SIZE
+*/
+static void read_lines(BollieDelayXT* self, const BollieCtl* ctl, bool mod,
+    bool taps_on, uint32_t n) {
+    const uint32_t channels = self->channels;
+    const int32_t pos_w = self->pos_w;
+    const int32_t buf_size = self->buf_size;
+    const float la = self->limiter.la;
+    const bool jump = jump_gains(self, n);
+    const BollieInterp q = jump && ctl->interp == BI_ALLPASS ?
+        BI_HERMITE : ctl->interp;
+    for (uint32_t c = 0 ; c < channels ; ++c) {
+        const float *d = self->sm_d_t[c].ramp;
+        float *old = self->blk_old[c];
+        if (!jump && !mod && q != BI_ALLPASS && self->sm_d_t[c].flat
+            && d[0] == floorf(d[0])) {
+            // Settled on a whole number of samples, nothing to interpolate
+            bi_copy(self->buffer[c], buf_size,
+                pos_w - (int32_t)read_distance(d[0], la), old, n);
+            continue;
+        }
+        if (la) {
+            // Read ahead by the lookahead of the limiter
+            for (uint32_t i = 0 ; i < n ; ++i)
+                self->blk_read[i] = read_distance(d[i], la);
+            d = self->blk_read;
+        }
+        bi_gather(q, self->buffer[c], buf_size, pos_w, d,
+            self->blk_lfo[c & 1], old, n, &self->ap[c]);
+        if (jump)
+            read_jump(self, q, c, pos_w, old, n);
+    }
+
+    // Additional read heads, gathered across the taps of each line
+    if (taps_on) {
+        for (uint32_t c = 0 ; c < channels ; ++c) {
+            memset(self->blk_tap[c], 0, n * sizeof(float));
+            memset(self->blk_tap_fb[c], 0, n * sizeof(float));
+        }
+        for (uint32_t c = 0 ; c < channels ; ++c) {
+            int p = self->layout->pair[c] < 0 ? (int)c : self->layout->pair[c];
+            bt_process_block(&self->taps[c], ctl->interp, self->buffer[c],
+                buf_size, pos_w, self->blk_lfo[c & 1], self->pow_fast,
+                self->pow_slow, self->blk_tap[p < (int)c ? p : (int)c],
+                self->blk_tap[p > (int)c ? p : (int)c], self->blk_tap_fb[c],
+                n);
+        }
+    }
+}
+
+
+/**
+* Lets decayed tails in blk_old end in zeros instead of denormals. Kept out
+* of line, so the CYCLE kernels share it.
+* \param self pointer to current plugin instance.
+* \param n number of samples in this block, not more than BLOCK_SIZE
+*/
+static __attribute__((noinline)) void flush_old(BollieDelayXT* self,
+    uint32_t n) {
+    for (uint32_t c = 0 ; c < self->channels ; ++c) {
+        float *o = self->blk_old[c];
+        for (uint32_t i = 0 ; i < n ; ++i)
+            o[i] = bdn_flush(o[i]);
+    }
+}
+
+
+/**
+* Adds crossfeed and tap feedback to the sums in blk_buf and writes them to
+* the delay lines.
+* \param self pointer to current plugin instance.
+* \param xfeed crossfeed matrix of the current mode
+* \param cf crossfeed ramp
+* \param taps_on any line has active taps
+* \param n number of samples in this block, not more than BLOCK_SIZE
+*/
+static void feed_lines(BollieDelayXT* self,
+    const float (*xfeed)[BF_CHANNELS], const float* cf, bool taps_on,
+    uint32_t n) {
+    const uint32_t channels = self->channels;
+    for (uint32_t c = 0 ; c < channels ; ++c) {
+        float *buf = self->blk_buf[c];
+        for (uint32_t j = 0 ; j < channels ; ++j) {
+            const float w = xfeed[j][c];
+            const float *o = self->blk_old[j];
+            if (w == 0)
+                continue;
+            for (uint32_t i = 0 ; i < n ; ++i)
+                buf[i] += w * o[i] * cf[i];
+        }
+        if (taps_on) {
+            const float *tap_fb = self->blk_tap_fb[c];
+            for (uint32_t i = 0 ; i < n ; ++i)
+                buf[i] += tap_fb[i];
+        }
+        write_block(self->buffer[c], self->buf_size, self->pos_w, buf, n);
+    }
+}
+
+
+/**
+* Mixes the dry signal, the delay lines and the taps into the outputs.
+* \param self pointer to current plugin instance.
+* \param offset offset of the block within the port buffers
+* \param gain_dry dry gain ramp
+* \param gain_wet wet gain ramp
+* \param taps_on any line has active taps
+* \param n number of samples in this block, not more than BLOCK_SIZE
+*/
+static void mix_outputs(BollieDelayXT* self, uint32_t offset,
+    const float* gain_dry, const float* gain_wet, bool taps_on, uint32_t n) {
+    const uint32_t channels = self->channels;
+    if (self->crossed) {
+        // Channels cross over in the host's buffers, read all of them first
+        for (uint32_t i = 0 ; i < n ; ++i) {
+            float s[MAX_CHANNELS];
+            for (uint32_t c = 0 ; c < channels ; ++c)
+                s[c] = self->input[c][offset + i];
+            for (uint32_t c = 0 ; c < channels ; ++c)
+                self->output[c][offset + i] = s[c] * gain_dry[i]
+                    + self->blk_old[c][i] * gain_wet[i];
+        }
+    }
+    else {
+        for (uint32_t c = 0 ; c < channels ; ++c) {
+            const float *in = self->input[c] + offset;
+            float *out = self->output[c] + offset;
+            const float *o = self->blk_old[c];
+            for (uint32_t i = 0 ; i < n ; ++i)
+                out[i] = in[i] * gain_dry[i] + o[i] * gain_wet[i];
+        }
+    }
+    if (taps_on) {
+        for (uint32_t c = 0 ; c < channels ; ++c) {
+            float *out = self->output[c] + offset;
+            const float *tap = self->blk_tap[c];
+            for (uint32_t i = 0 ; i < n ; ++i)
+                out[i] += tap[i] * gain_wet[i];
+        }
+    }
+}
+
+
+/**
+* Toggles a CYCLE kernel is specialized for, as bits of its index in
+* cycle_kernels
+*/
+enum {
+    CK_PING_PONG = 1,
+    CK_HCF_FB = 2,
+    CK_LCF_FB = 4,
+    CK_HCF_PRE = 8,
+    CK_LCF_PRE = 16,
+    CK_MOD = 32,
+    CK_KERNELS = 64
+};
+
+
+/**
+* Processes a block in stages: smoothing, LFO, delay reads, limiter,
+* feedback filters, pre filters, buffer write and final mix. Each stage is a
+* tight loop over the scratch arrays of one channel after the other. Only
+* valid if block_path_ok() agrees. Always inlined with a constant set of
+* toggles, so each kernel in cycle_kernels only holds the stages it runs.
+* \param self pointer to current plugin instance.
+* \param ctl control values of this run
+* \param offset offset of the block within the port buffers
+* \param n number of samples in this block, not more than BLOCK_SIZE
+* \param k CK_ toggles, must match ctl
+*/
+static inline __attribute__((always_inline)) void cycle_block(
+    BollieDelayXT* self, const BollieCtl* ctl, uint32_t offset, uint32_t n,
+    const uint32_t k) {
+
+    const uint32_t channels = self->channels;
+    float *lfo_even = self->blk_lfo[0];
+    float *lfo_odd = self->blk_lfo[1];
+    float *old[MAX_CHANNELS];
+    float *fil[MAX_CHANNELS];
+    bool taps_on = false;
+    for (uint32_t c = 0 ; c < channels ; ++c) {
+        old[c] = self->blk_old[c];
+        fil[c] = self->blk_fil[c];
+        taps_on = taps_on || self->taps[c].active;
+    }
+    bpr_start(&self->profile);
+
+    // Parameter smoothing
+    smooth_block(self, ctl, n);
+    const float *gain_buf_in = self->sm_gain_buf_in.ramp;
+    const float *fb = self->sm_fb.ramp;
+
+    // LFO, main and quadrature output are turned into offsets in place
+    if (k & CK_MOD) {
+        const float *mod_depth = bsm_block(&self->sm_mod_depth, n);
+        bl_process_block(&self->lfo, lfo_even, lfo_odd, n);
+        const float rc = ctl->mod_rot_c;
+        const float rs = ctl->mod_rot_s;
+        for (uint32_t i = 0 ; i < n ; ++i) {
+            float depth = mod_depth[i] * self->ms_to_samples;
+            float v = lfo_even[i];
+            float q = lfo_odd[i];
+            lfo_even[i] = depth * v;
+            lfo_odd[i] = depth * (v * rc + q * rs);
+        }
+    }
+    else {
+        memset(lfo_even, 0, n * sizeof(float));
+        memset(lfo_odd, 0, n * sizeof(float));
+    }
+    bpr_mark(&self->profile, BPR_SMOOTH);
+
+    read_lines(self, ctl, k & CK_MOD, taps_on, n);
+    bpr_mark(&self->profile, BPR_READS);
+
+    // Limiter
+    blm_process_block(&self->limiter, old, n);
+    bpr_mark(&self->profile, BPR_LIMITER);
+
+    // Feedback filters
+    if (k & CK_HCF_FB)
+        bfb_process_block(&self->fil_hcf_fb, (const float* const*)old, old,
+            channels, n);
+    if (k & CK_LCF_FB)
+        bfb_process_block(&self->fil_lcf_fb, (const float* const*)old, old,
+            channels, n);
+
+    flush_old(self, n);
+    bpr_mark(&self->profile, BPR_FB_FILTERS);
+
+    // Pre filters
+    for (uint32_t c = 0 ; c < channels ; ++c)
+        memcpy(fil[c], self->input[c] + offset, n * sizeof(float));
+    if (k & CK_HCF_PRE)
+        bfb_process_block(&self->fil_hcf_pre, (const float* const*)fil, fil,
+            channels, n);
+    if (k & CK_LCF_PRE)
+        bfb_process_block(&self->fil_lcf_pre, (const float* const*)fil, fil,
+            channels, n);
+    bpr_mark(&self->profile, BPR_PRE_FILTERS);
+
+    // Summing for the delay lines
+    if (k & CK_PING_PONG) {
+        float *buf = self->blk_buf[0];
+        const float pp_in = self->pp_in;
+        memset(buf, 0, n * sizeof(float));
+        for (uint32_t c = 0 ; c < channels ; ++c) {
+            const float *f = fil[c];
+            for (uint32_t i = 0 ; i < n ; ++i)
+                buf[i] += f[i] * pp_in;
+        }
+        for (uint32_t i = 0 ; i < n ; ++i)
+            buf[i] = gain_buf_in[i] * buf[i];
+        for (uint32_t c = 1 ; c < channels ; ++c)
+            memset(self->blk_buf[c], 0, n * sizeof(float));
+    }
+    else {
+        for (uint32_t c = 0 ; c < channels ; ++c) {
+            float *buf = self->blk_buf[c];
+            const float *f = fil[c];
+            const float *o = old[c];
+            for (uint32_t i = 0 ; i < n ; ++i)
+                buf[i] = gain_buf_in[i] * f[i] + o[i] * fb[i];
+        }
+    }
+    feed_lines(self, self->xfeed[k & CK_PING_PONG ? 1 : 0], self->sm_cf.ramp,
+        taps_on, n);
+
+    // Final summing
+    mix_outputs(self, offset, self->sm_gain_dry.ramp, self->sm_gain_wet.ramp,
+        taps_on, n);
+
+    self->pos_w = (self->pos_w + (int32_t)n) & self->buf_mask;
+    jump_advance(self, ctl, n);
+    bpr_mark(&self->profile, BPR_MIX);
+}
+
+
+/**
+* Defines the CYCLE kernel with index 8 * a + b.
+*/
+#define CYCLE_KERNEL(a, b) \
+    static void cycle_kernel_##a##b(BollieDelayXT* self, \
+        const BollieCtl* ctl, uint32_t offset, uint32_t n) { \
+        cycle_block(self, ctl, offset, n, 8 * a + b); \
+    }
+#define CYCLE_KERNEL_ROW(a) \
+    CYCLE_KERNEL(a, 0) CYCLE_KERNEL(a, 1) CYCLE_KERNEL(a, 2) \
+    CYCLE_KERNEL(a, 3) CYCLE_KERNEL(a, 4) CYCLE_KERNEL(a, 5) \
+    CYCLE_KERNEL(a, 6) CYCLE_KERNEL(a, 7)
+#define CYCLE_KERNEL_PTRS(a) \
+    cycle_kernel_##a##0, cycle_kernel_##a##1, cycle_kernel_##a##2, \
+    cycle_kernel_##a##3, cycle_kernel_##a##4, cycle_kernel_##a##5, \
+    cycle_kernel_##a##6, cycle_kernel_##a##7
+
+CYCLE_KERNEL_ROW(0)
+CYCLE_KERNEL_ROW(1)
+CYCLE_KERNEL_ROW(2)
+CYCLE_KERNEL_ROW(3)
+CYCLE_KERNEL_ROW(4)
+CYCLE_KERNEL_ROW(5)
+CYCLE_KERNEL_ROW(6)
+CYCLE_KERNEL_ROW(7)
+
+/**
+* Signature of a CYCLE kernel
+*/
+typedef void (*CycleKernel)(BollieDelayXT* self, const BollieCtl* ctl,
+    uint32_t offset, uint32_t n);
+
+/**
+* CYCLE kernels, one per combination of CK_ toggles
+*/
+static const CycleKernel cycle_kernels[CK_KERNELS] = {
+    CYCLE_KERNEL_PTRS(0), CYCLE_KERNEL_PTRS(1), CYCLE_KERNEL_PTRS(2),
+    CYCLE_KERNEL_PTRS(3), CYCLE_KERNEL_PTRS(4), CYCLE_KERNEL_PTRS(5),
+    CYCLE_KERNEL_PTRS(6), CYCLE_KERNEL_PTRS(7)
+};
+
+
+/**
+* Processes a block with the CYCLE kernel for the current toggles. Only
+* valid if block_path_ok() agrees.
+* \param self pointer to current plugin instance.
+* \param ctl control values of this run
+* \param offset offset of the block within the port buffers
+* \param n number of samples in this block, not more than BLOCK_SIZE
+*/
+static void run_block(BollieDelayXT* self, const BollieCtl* ctl,
+    uint32_t offset, uint32_t n) {
+    uint32_t k = (ctl->cp_ping_pong ? CK_PING_PONG : 0)
+        | (ctl->cp_hcf_fb_on ? CK_HCF_FB : 0)
+        | (ctl->cp_lcf_fb_on ? CK_LCF_FB : 0)
+        | (ctl->cp_hcf_pre_on ? CK_HCF_PRE : 0)
+        | (ctl->cp_lcf_pre_on ? CK_LCF_PRE : 0)
+        | (!self->sm_mod_depth.flat || ctl->cp_mod_on ? CK_MOD : 0);
+    cycle_kernels[k](self, ctl, offset, n);
+}
+
+
+/**
+* Glides the LFO phase offset of the odd channels towards 0 or 180 degrees
+* and updates the rotation used for their LFO output.
+* \param self pointer to current plugin instance.
+* \param ctl control values of this run
+* \param n number of samples in the next block
+*/
+static void glide_mod_phase(BollieDelayXT* self, BollieCtl* ctl, uint32_t n) {
+    float tgt_mod_phase = ctl->cp_mod_phase ? M_PI : 0;
+    float max_step = M_PI * n / (MOD_PHASE_GLIDE_MS * self->ms_to_samples);
+    float step = tgt_mod_phase - self->cur_mod_phase;
+    self->cur_mod_phase += fmaxf(-max_step, fminf(max_step, step));
+    ctl->mod_rot_c = cosf(self->cur_mod_phase);
+    ctl->mod_rot_s = sinf(self->cur_mod_phase);
+}
+
+
+/**
+* Flushes recursive states, that have decayed below audibility, to zero. With
+* feedback and filters on, they would otherwise end up in the denormal range
+* seconds after the input stopped.
+* \param self pointer to current plugin instance.
+*/
+static void flush_states(BollieDelayXT* self) {
+    bfb_flush(&self->fil_hcf_fb);
+    bfb_flush(&self->fil_lcf_fb);
+    bfb_flush(&self->fil_hcf_pre);
+    bfb_flush(&self->fil_lcf_pre);
+    blm_flush(&self->limiter);
+
+    for (uint32_t c = 0 ; c < self->channels ; ++c) {
+        self->ap[c].x1 = bdn_flush(self->ap[c].x1);
+        self->ap[c].y1 = bdn_flush(self->ap[c].y1);
+        bt_flush(&self->taps[c]);
+    }
+}
+
+
+/**
+* Takes over the values of the control ports, that have changed since the
+* last run. Values set through patch:Set stay until the port changes.
+* \param self pointer to current plugin instance.
+*/
+static void read_ports(BollieDelayXT* self) {
+    for (int i = 0 ; i < N_PARAMS ; ++i) {
+        if (!self->cp[i])
+            continue;
+        float v = *self->cp[i];
+        if (v != self->params_port[i] || !self->params_valid) {
+            self->params_port[i] = v;
+            self->params[i] = v;
+        }
+    }
+    self->params_valid = true;
+}
+
+
+/**
+* Returns the current value of a parameter.
+* \param self pointer to current plugin instance.
+* \param port control port of the parameter
+* \return parameter value
+*/
+static inline float param(const BollieDelayXT* self, PortIdx port) {
+    return self->params[port - CP_ENABLED];
+}
+
+
+/**
+* Reads a numeric atom.
+* \param u mapped URIs
+* \param a the atom
+* \param v destination of the value
+* \return true, if the atom is a number
+*/
+static bool atom_number(const BollieUrids* u, const LV2_Atom* a, float* v) {
+    if (a->type == u->atom_Float)
+        *v = ((const LV2_Atom_Float*)a)->body;
+    else if (a->type == u->atom_Double)
+        *v = ((const LV2_Atom_Double*)a)->body;
+    else if (a->type == u->atom_Int || a->type == u->atom_Bool)
+        *v = ((const LV2_Atom_Int*)a)->body;
+    else if (a->type == u->atom_Long)
+        *v = ((const LV2_Atom_Long*)a)->body;
+    else
+        return false;
+    return true;
+}
+
+
+/**
+* Applies a patch:Set message from the control port.
+* \param self pointer to current plugin instance.
+* \param obj the message
+* \return true, if a parameter has been changed
+*/
+static bool patch_set(BollieDelayXT* self, const LV2_Atom_Object* obj) {
+    const BollieUrids* u = &self->urids;
+    const LV2_Atom* property = NULL;
+    const LV2_Atom* value = NULL;
+
+    lv2_atom_object_get(obj, u->patch_property, &property,
+        u->patch_value, &value, 0);
+    if (!property || !value || property->type != u->atom_URID)
+        return false;
+
+    LV2_URID key = ((const LV2_Atom_URID*)property)->body;
+    int i = 0;
+    while (i < N_PARAMS && (!self->params_urid[i]
+        || self->params_urid[i] != key))
+        ++i;
+    if (i == N_PARAMS)
+        return false;
+
+    return atom_number(u, value, &self->params[i]);
+}
+
+
+/**
+* Takes the host tempo from a time:Position object. Changes within
+* TEMPO_HYSTERESIS are ignored. While the transport is rolling, a new tempo
+* is held back until the next beat, so the repeats already in the delay
+* lines stay on the grid.
+* \param self pointer to current plugin instance.
+* \param obj the time:Position object
+* \return true, if the host tempo has been changed right away
+*/
+static bool time_position(BollieDelayXT* self, const LV2_Atom_Object* obj) {
+    const BollieUrids* u = &self->urids;
+    const LV2_Atom* bpm = NULL;
+    const LV2_Atom* bar_beat = NULL;
+    const LV2_Atom* speed = NULL;
+    float v, beat;
+
+    lv2_atom_object_get(obj, u->time_beatsPerMinute, &bpm,
+        u->time_barBeat, &bar_beat, u->time_speed, &speed, 0);
+
+    if (speed)
+        atom_number(u, speed, &self->host_speed);
+
+    if (!bpm || !atom_number(u, bpm, &v) || v < 1.f)
+        return false;
+    self->host_bpm_atom = true;
+
+    // Jitter, also drops a change, that has been taken back before the beat
+    if (fabsf(v - self->host_bpm) <= TEMPO_HYSTERESIS) {
+        self->pending_bpm = 0;
+        return false;
+    }
+
+    if (self->host_bpm > 0 && self->host_speed != 0 && bar_beat
+        && atom_number(u, bar_beat, &beat)) {
+        double frames_per_beat = 60. * self->sample_rate
+            / (self->host_bpm * fabsf(self->host_speed));
+        self->pending_bpm = v;
+        self->pending_frames = ceil((1. - (beat - floorf(beat)))
+            * frames_per_beat);
+        return false;
+    }
+
+    self->host_bpm = v;
+    self->pending_bpm = 0;
+    return true;
+}
+
+
+/**
+* Converts a gain parameter to a factor. Everything below -96 dB is muted.
+* \param db gain in dB
+* \return gain factor
+*/
+static float db_to_gain(float db) {
+    if (db > 12.f)
+        return 4.f;
+    if (db < -96.f)
+        return 0;
+    return powf(10, (db/20));
+}
+
+
+/**
+* Sets the targets of the taps of a channel. Their feedback is scaled down
+* to what the main feedback leaves, so the loop gain can't exceed unity.
+* \param self pointer to current plugin instance.
+* \param bt taps of the channel
+* \param base first tap port of the channel
+* \param tempo current tempo in BPM
+* \param paired the channel has a pair to pan to, otherwise all taps stay
+*        on the first output
+*/
+static void apply_taps(BollieDelayXT* self, BollieTaps* bt, PortIdx base,
+    float tempo, bool paired) {
+    float fb[BT_TAPS];
+    float fb_sum = 0;
+    for (int t = 0 ; t < BT_TAPS ; ++t) {
+        fb[t] = fminf(fmaxf(param(self, base + t * TP_PORTS + TP_FB) / 100,
+            0), 1.f);
+        fb_sum += fb[t];
+    }
+    float fb_room = 1.f - self->tgt_fb;
+    float fb_scale = fb_sum > fb_room ? fb_room / fb_sum : 1.f;
+
+    for (int t = 0 ; t < BT_TAPS ; ++t) {
+        PortIdx p = base + t * TP_PORTS;
+        float d = calc_delay_samples(self, tempo, param(self, p + TP_DIV));
+        if (d + self->mod_offset_samples >= self->buf_size)
+            d = self->buf_size - self->mod_offset_samples - 1;
+
+        // Constant power panning, -100 is the first output only
+        float gain = db_to_gain(param(self, p + TP_GAIN));
+        float pan = paired ?
+            fminf(fmaxf(param(self, p + TP_PAN), -100.f), 100.f) : -100.f;
+        float a = (pan / 100 + 1) * (float)M_PI_4;
+        bt_set(bt, t, d, gain * fmaxf(cosf(a), 0), gain * fmaxf(sinf(a), 0),
+            fb[t] * fb_scale);
+    }
+}
+
+
+/**
+* Derives the smoother targets and the control values of the processing
+* paths from the parameters.
+* \param self pointer to current plugin instance.
+* \param ctl control values to fill in
+*/
+static void apply_params(BollieDelayXT* self, BollieCtl* ctl) {
+    // Tempo handling
+    // The host tempo port is the fallback, if there's no time:Position
+    float host_port = param(self, CP_TEMPO_HOST);
+    if (!self->host_bpm_atom
+        && fabsf(host_port - self->host_bpm) > TEMPO_HYSTERESIS)
+        self->host_bpm = host_port;
+
+    // Tempo mode has changed
+    float cur_tempo = (param(self, CP_TEMPO_MODE) == 1 ?
+        param(self, CP_TEMPO_USER) : self->host_bpm);
+    float div_ch1 = param(self, CP_TEMPO_DIV_CH1);
+    float div_ch2 = param(self, CP_TEMPO_DIV_CH2);
+
+    bool jump = param(self, CP_DELAY_JUMP) > 0.5f;
+
+    // Tempo has changed
+    if (cur_tempo != self->cur_tempo
+        || self->cur_tempo_div_ch1 != div_ch1
+        || self->cur_tempo_div_ch2 != div_ch2
+        || self->cur_delay_jump != jump
+    ) {
+        // Even channels follow the ch1 division, odd ones the ch2 one
+        for (uint32_t c = 0 ; c < self->channels ; ++c) {
+            float d = calc_delay_samples(self, cur_tempo,
+                c & 1 ? div_ch2 : div_ch1);
+
+            // Jumps land on whole samples, to be read without interpolation
+            if (jump)
+                d = rintf(d);
+
+            // Safety! Stay within what the buffers can hold
+            if (d + self->mod_offset_samples >= self->buf_size)
+                d = self->buf_size - self->mod_offset_samples - 1;
+            self->tgt_d_t[c] = d;
+        }
+
+        self->cur_tempo = cur_tempo;
+        self->cur_tempo_div_ch1 = div_ch1;
+        self->cur_tempo_div_ch2 = div_ch2;
+        self->cur_delay_jump = jump;
+        *self->cp_tempo_out = cur_tempo;
+    }
+
+    // Gain handling
+    float gain_dry = param(self, CP_GAIN_DRY);
+    float gain_wet = param(self, CP_GAIN_WET);
+
+    if (gain_dry != self->cur_cp_gain_dry) {
+        self->tgt_gain_dry = db_to_gain(gain_dry);
+        self->cur_cp_gain_dry = gain_dry;
+    }
+
+    if (gain_wet != self->cur_cp_gain_wet) {
+        self->tgt_gain_wet = db_to_gain(gain_wet);
+        self->cur_cp_gain_wet = gain_wet;
+    }
+
+    // Feedback
+    float fb = param(self, CP_FB);
+    if (!param(self, CP_PING_PONG)) {
+        if (fb != self->cur_cp_fb) {
+            if (fb > 99.f ) {
+                self->tgt_fb = 1.f;
+            }
+            else if (fb < 0) {
+                self->tgt_fb = 0;
+            }
+            else {
+                self->tgt_fb = fb / 100;
+            }
+            self->cur_cp_fb = fb;
+        }
+    }
+    else {
+        // ping pong mode. We don't want any FB here
+        self->tgt_fb = 0;
+    }
+
+    // Crossfeed
+    float cf = param(self, CP_CF);
+    if (cf != self->cur_cp_cf) {
+        if (cf > 99.f) {
+            self->tgt_cf = 1.f;
+        }
+        else if (cf < 0) {
+            self->tgt_cf = 0;
+        }
+        else {
+            self->tgt_cf = cf / 100;
+        }
+        self->cur_cp_cf = cf;
+    }
+
+    // Taps
+    for (uint32_t c = 0 ; c < self->channels ; ++c)
+        apply_taps(self, &self->taps[c], c & 1 ? CP_TAPS_CH2 : CP_TAPS_CH1,
+            cur_tempo, self->layout->pair[c] >= 0);
+
+    // Limiter
+    blm_set(&self->limiter, param(self, CP_LIM_LINK) > 0.5f,
+        param(self, CP_LIM_LOOKAHEAD));
+
+    *ctl = (BollieCtl){
+        .cp_enabled = param(self, CP_ENABLED),
+        .cp_trails = param(self, CP_TRAILS),
+        .cp_ping_pong = param(self, CP_PING_PONG),
+        .cp_mod_on = param(self, CP_MOD_ON),
+        .cp_mod_phase = param(self, CP_MOD_PHASE),
+        .cp_mod_depth = param(self, CP_MOD_DEPTH),
+        .cp_mod_rate = param(self, CP_MOD_RATE),
+        .cp_hcf_pre_on = param(self, CP_HCF_PRE_ON),
+        .cp_hcf_pre_freq = param(self, CP_HCF_PRE_FREQ),
+        .cp_hcf_pre_q = param(self, CP_HCF_PRE_Q),
+        .cp_lcf_pre_on = param(self, CP_LCF_PRE_ON),
+        .cp_lcf_pre_freq = param(self, CP_LCF_PRE_FREQ),
+        .cp_lcf_pre_q = param(self, CP_LCF_PRE_Q),
+        .cp_hcf_fb_on = param(self, CP_HCF_FB_ON),
+        .cp_hcf_fb_freq = param(self, CP_HCF_FB_FREQ),
+        .cp_hcf_fb_q = param(self, CP_HCF_FB_Q),
+        .cp_lcf_fb_on = param(self, CP_LCF_FB_ON),
+        .cp_lcf_fb_freq = param(self, CP_LCF_FB_FREQ),
+        .cp_lcf_fb_q = param(self, CP_LCF_FB_Q),
+        .cp_delay_jump = jump
+    };
+
+    // Modulation
+    if (ctl->cp_mod_depth < 0.1f || ctl->cp_mod_depth > MOD_OFFSET_MS)
+        ctl->cp_mod_depth = 2.f;
+
+    if (ctl->cp_mod_rate < 0.1f || ctl->cp_mod_rate > 2.f)
+        ctl->cp_mod_rate = 0.1f;
+
+    int shape = param(self, CP_MOD_SHAPE);
+    bl_set(&self->lfo, shape >= BL_SINE && shape <= BL_RANDOM ?
+        (BollieLfoShape)shape : BL_SINE, ctl->cp_mod_rate);
+
+    // Modulation has faded out completely, restart the LFO from zero
+    if (!ctl->cp_mod_on && self->sm_mod_depth.cur == 0)
+        bl_reset(&self->lfo);
+
+    /* Interpolation. The allpass can't follow modulation, use the cubic
+       kernel then. */
+    int interp = param(self, CP_INTERP);
+    ctl->interp = interp >= BI_LINEAR && interp <= BI_ALLPASS ? 
+        (BollieInterp)interp : BI_LINEAR;
+    if (ctl->interp == BI_ALLPASS
+        && (ctl->cp_mod_on || self->sm_mod_depth.cur > 0))
+        ctl->interp = BI_HERMITE;
+
+    if (ctl->interp == BI_ALLPASS && !self->ap_active) {
+        for (uint32_t c = 0 ; c < self->channels ; ++c) {
+            bi_allpass_prime(&self->ap[c], self->buffer[c], self->buf_size,
+                (double)self->pos_w - self->sm_d_t[c].cur);
+            bt_allpass_prime(&self->taps[c], self->buffer[c], self->buf_size,
+                self->pos_w);
+        }
+    }
+    self->ap_active = ctl->interp == BI_ALLPASS;
+
+    // User disabled the plugin, fade out
+    if (!ctl->cp_enabled && self->state != FADE_OUT_DONE && !ctl->cp_trails)
+        self->state = FADE_OUT;
+}
+
+
+/**
+* Asks the worker to commit the delay lines ahead of the write head, before
+* it gets there. Once the write head has been through all of the lines,
+* they stay committed until the next activate().
+* \param self pointer to current plugin instance.
+* \param n number of samples about to be written
+*/
+static void commit_ahead(BollieDelayXT* self, uint32_t n) {
+    if (self->ring_ready >= self->buf_size || self->ring_pending)
+        return;
+    int32_t to = self->pos_w + (int32_t)n + COMMIT_AHEAD;
+    if (to <= self->ring_ready)
+        return;
+
+    // Twice as far, so there's a request every COMMIT_AHEAD samples
+    to += COMMIT_AHEAD;
+    if (to > self->buf_size)
+        to = self->buf_size;
+    BollieRingWork w = { self->ring_gen, self->ring_ready, to };
+    self->ring_pending = self->schedule->schedule_work(
+        self->schedule->handle, sizeof(w), &w) == LV2_WORKER_SUCCESS;
+}
+
+
+/**
+* Makes sure, the read heads only find samples written since activate().
+* Clears just the region, that the delay times reach during the next n
+* samples, so re-activation costs nothing up front and a long delay line
+* is cleared bit by bit while the delay time glides up.
+* \param self pointer to current plugin instance.
+* \param n number of samples about to be processed
+*/
+static void clear_ahead(BollieDelayXT* self, uint32_t n) {
+    float d = 0;
+    for (uint32_t c = 0 ; c < self->channels ; ++c) {
+        const BollieSmooth* sm = &self->sm_d_t[c];
+        d = fmaxf(d, fmaxf(sm->cur, self->tgt_d_t[c]
+            + (sm->cur - self->tgt_d_t[c]) * bsm_coeff(sm, n)));
+        if (self->jump_pos < self->jump_length)
+            d = fmaxf(d, self->jump_from[c]);
+        d = fmaxf(d, bt_longest(&self->taps[c]));
+    }
+
+    // Modulation and the interpolation kernels reach a little further
+    int32_t reach = (int32_t)ceilf(d) + self->mod_offset_samples + 4;
+    if (reach > self->buf_size)
+        reach = self->buf_size;
+
+    if (reach > self->lines_clean) {
+        clear_range(self, self->pos_w - reach, reach - self->lines_clean);
+        self->lines_clean = reach;
+    }
+}
+
+
+/**
+* Starts over with filling the delay lines, once the delay has faded out
+* and got enabled again. The write head starts at 0 and nothing behind it
+* counts as cleared, so clear_ahead() clears what the read heads reach
+* before the delay fades in again.
+* \param self pointer to current plugin instance.
+*/
+static void restart_lines(BollieDelayXT* self) {
+    self->pos_w = 0;
+    self->lines_clean = 0;
+    self->state = FILL_BUF;
+}
+
+
+/**
+* Accounts for n samples written at the write head before it moved on.
+* \param self pointer to current plugin instance.
+* \param pos_w write position before the samples were written, -1 if only
+*        zeros have been written through clear_range()
+* \param n number of samples written
+*/
+static void lines_written(BollieDelayXT* self, int32_t pos_w, uint32_t n) {
+    self->lines_clean = self->lines_clean + (int32_t)n < self->buf_size ?
+        self->lines_clean + (int32_t)n : self->buf_size;
+    if (pos_w < 0)
+        return;
+    int32_t end = pos_w + (int32_t)n < self->buf_size ?
+        pos_w + (int32_t)n : self->buf_size;
+    if (end > self->lines_used)
+        self->lines_used = end;
+}
+
+
+/**
+* Processes a stretch of samples with constant control values. Runs the
+* block pipeline where the delay is long enough and falls back to sample by
+* sample processing otherwise.
+* \param self pointer to current plugin instance.
+* \param ctl control values
+* \param offset offset within the port buffers
+* \param n_samples number of samples
+*/
+static void process(BollieDelayXT* self, BollieCtl* ctl, uint32_t offset,
+    uint32_t n_samples) {
+    for (uint32_t end = offset + n_samples ; offset < end ; ) {
+        uint32_t n = end - offset;
+        if (n > BLOCK_SIZE)
+            n = BLOCK_SIZE;
+
+        // Disabled and faded out, just pass the input through
+        if (self->state == FADE_OUT_DONE && !ctl->cp_enabled) {
+            run_bypass(self, offset, n);
+            offset += n;
+            continue;
+        }
+
+        // Enabled again, start over with filling the delay lines
+        if (self->state == FADE_OUT_DONE)
+            restart_lines(self);
+
+        clear_ahead(self, n);
+
+        /* Nothing audible in the delay lines and silence at the input.
+           Idle up to the first sample, that isn't silent. */
+        if (idle_ok(self, ctl)) {
+            uint32_t m = quiet_len(self, offset, n);
+            if (m) {
+                glide_mod_phase(self, ctl, m);
+                run_idle(self, ctl, offset, m);
+                lines_written(self, -1, m);
+                offset += m;
+                continue;
+            }
+        }
+
+        glide_mod_phase(self, ctl, n);
+        commit_ahead(self, n);
+
+        /* Filter coefficients are only recalculated on change and ramped
+           across this block */
+        bfb_set_params(&self->fil_hcf_fb, BF_HCF, ctl->cp_hcf_fb_freq,
+            ctl->cp_hcf_fb_q, self->sample_rate, n);
+        bfb_set_params(&self->fil_lcf_fb, BF_LCF, ctl->cp_lcf_fb_freq,
+            ctl->cp_lcf_fb_q, self->sample_rate, n);
+        bfb_set_params(&self->fil_hcf_pre, BF_HCF, ctl->cp_hcf_pre_freq,
+            ctl->cp_hcf_pre_q, self->sample_rate, n);
+        bfb_set_params(&self->fil_lcf_pre, BF_LCF, ctl->cp_lcf_pre_freq,
+            ctl->cp_lcf_pre_q, self->sample_rate, n);
+
+        int32_t pos_w = self->pos_w;
+        if (block_path_ok(self, ctl, n))
+            run_block(self, ctl, offset, n);
+        else
+            n = run_samples(self, ctl, offset, n);
+        lines_written(self, pos_w, n);
+
+        // Keep track of how long the delay lines have been silent
+        float peak = 0;
+        for (uint32_t c = 0 ; c < self->channels ; ++c)
+            peak = fmaxf(peak,
+                ring_peak(self->buffer[c], self->buf_size, pos_w, n));
+        if ((self->state != CYCLE && self->state != FILL_BUF)
+            || peak >= IDLE_LEVEL)
+            self->quiet_count = 0;
+        else if (self->quiet_count < self->buf_size)
+            self->quiet_count += n;
+
+        offset += n;
+    }
+
+}
+
+
+/**
+* Takes over a restored state. Before anything has been written since
+* activate(), the smoothers start right at the saved values and the delay
+* skips filling and fading in. The delay lines are cleared ahead of the
+* read heads, so there's nothing to click. A state restored while cycling
+* only brings the host tempo along, the ports glide as usual.
+* \param self pointer to current plugin instance.
+*/
+static void warm_start(BollieDelayXT* self) {
+    BollieWarm* w = &self->warm;
+    w->valid = false;
+
+    if (w->host_bpm > 0) {
+        self->host_bpm = w->host_bpm;
+        self->host_bpm_atom = true;
+    }
+
+    if (self->state != FILL_BUF || self->pos_w)
+        return;
+
+    for (uint32_t c = 0 ; c < self->channels ; ++c) {
+        self->tgt_d_t[c] = (c & 1 ? w->d_t_ch2 : w->d_t_ch1)
+            * self->sample_rate;
+        bsm_reset(&self->sm_d_t[c], self->tgt_d_t[c]);
+    }
+    bsm_reset(&self->sm_gain_dry, self->tgt_gain_dry = w->gain_dry);
+    bsm_reset(&self->sm_gain_wet, self->tgt_gain_wet = w->gain_wet);
+    bsm_reset(&self->sm_fb, self->tgt_fb = w->fb);
+    bsm_reset(&self->sm_cf, self->tgt_cf = w->cf);
+    bsm_reset(&self->sm_gain_buf_in, 1.f);
+    self->state = CYCLE;
+    self->fade_pos = self->fade_length;
+}
+
+
+/**
+* Processes up to a frame of the current block. A pending host tempo change
+* is applied on the way, at the beat it has been held back for.
+* \param self pointer to current plugin instance.
+* \param ctl control values
+* \param offset current offset within the port buffers, advanced to end
+* \param end frame to process up to
+*/
+static void run_to(BollieDelayXT* self, BollieCtl* ctl, uint32_t* offset,
+    uint32_t end) {
+    while (*offset < end) {
+        uint32_t n = end - *offset;
+        if (self->pending_bpm > 0) {
+            if (self->pending_frames == 0) {
+                self->host_bpm = self->pending_bpm;
+                self->pending_bpm = 0;
+                apply_params(self, ctl);
+                continue;
+            }
+            if (n > self->pending_frames)
+                n = self->pending_frames;
+            self->pending_frames -= n;
+        }
+        process(self, ctl, *offset, n);
+        *offset += n;
+    }
+}
+
+
+/**
+* Ends the timing of a run and writes the load output ports.
+* \param self pointer to current plugin instance.
+* \param n_samples number of samples of the run
+*/
+static void publish_profile(BollieDelayXT* self, uint32_t n_samples) {
+    BollieProfile* p = &self->profile;
+    bpr_end(p, n_samples);
+    for (int v = 0 ; v < BPR_VALUES ; ++v) {
+        *self->cp_profile_out[2 * v] = p->avg[v];
+        *self->cp_profile_out[2 * v + 1] = bpr_max(p, (BollieStage)v);
+    }
+}
+
+
+/**
+* Main process function of the plugin.
+* \param instance  handle of the current plugin
+* \param n_samples number of samples in this current input block.
+*/
+static void run(LV2_Handle instance, uint32_t n_samples) {
+    BollieDelayXT* self = (BollieDelayXT*)instance;
+
+    // No denormals in here, the host gets its FPU state back at the end
+    BollieFpuState fpu = bdn_enter();
+
+    BollieCtl ctl;
+    self->crossed = ports_crossed(self);
+    read_ports(self);
+    bpr_begin(&self->profile, param(self, CP_PROFILE) > 0.5f);
+    if (self->warm.valid)
+        warm_start(self);
+    apply_params(self, &ctl);
+
+    /* Parameter changes and transport updates through the control port
+       take effect at their timestamps, splitting the block */
+    uint32_t offset = 0;
+    if (self->cp_control) {
+        const BollieUrids* u = &self->urids;
+        LV2_ATOM_SEQUENCE_FOREACH(self->cp_control, ev) {
+            const LV2_Atom_Object* obj = (const LV2_Atom_Object*)&ev->body;
+            if ((obj->atom.type != u->atom_Object
+                && obj->atom.type != u->atom_Blank)
+                || (obj->body.otype != u->patch_Set
+                && obj->body.otype != u->time_Position))
+                continue;
+
+            uint32_t t = ev->time.frames < offset ? offset :
+                ev->time.frames > n_samples ? n_samples : ev->time.frames;
+            run_to(self, &ctl, &offset, t);
+
+            bool changed = obj->body.otype == u->patch_Set ?
+                patch_set(self, obj) : time_position(self, obj);
+            if (changed)
+                apply_params(self, &ctl);
+        }
+    }
+
+    run_to(self, &ctl, &offset, n_samples);
+
+    flush_states(self);
+    publish_profile(self, n_samples);
+    bdn_leave(fpu);
+}
+
+
+/**
+* Saves the settled smoother targets and the host tempo.
+*/
+static LV2_State_Status save(LV2_Handle instance,
+    LV2_State_Store_Function store, LV2_State_Handle handle, uint32_t flags,
+    const LV2_Feature* const* features) {
+    BollieDelayXT* self = (BollieDelayXT*)instance;
+    const BollieUrids* u = &self->urids;
+    const uint32_t fl = LV2_STATE_IS_POD | LV2_STATE_IS_PORTABLE;
+
+    if (!u->atom_Float)
+        return LV2_STATE_ERR_NO_FEATURE;
+
+    // The first even and odd channel stand for the rest
+    float d_t_ch1 = self->tgt_d_t[0] / self->sample_rate;
+    float d_t_ch2 = self->tgt_d_t[self->channels > 1 ? 1 : 0]
+        / self->sample_rate;
+
+    if (self->host_bpm_atom)
+        store(handle, u->state_hostTempo, &self->host_bpm, sizeof(float),
+            u->atom_Float, fl);
+    store(handle, u->state_delayCh1, &d_t_ch1, sizeof(float), u->atom_Float,
+        fl);
+    store(handle, u->state_delayCh2, &d_t_ch2, sizeof(float), u->atom_Float,
+        fl);
+    store(handle, u->state_gainDry, &self->tgt_gain_dry, sizeof(float),
+        u->atom_Float, fl);
+    store(handle, u->state_gainWet, &self->tgt_gain_wet, sizeof(float),
+        u->atom_Float, fl);
+    store(handle, u->state_feedback, &self->tgt_fb, sizeof(float),
+        u->atom_Float, fl);
+    store(handle, u->state_crossfeed, &self->tgt_cf, sizeof(float),
+        u->atom_Float, fl);
+
+    return LV2_STATE_SUCCESS;
+}
+
+
+/**
+* Fetches a float value from a saved state.
+* \return true, if the key has been found with the right type
+*/
+static bool retrieve_float(const BollieUrids* u,
+    LV2_State_Retrieve_Function retrieve, LV2_State_Handle handle,
+    LV2_URID key, float* v) {
+    size_t size;
+    uint32_t type, flags;
+    const void* data = retrieve(handle, key, &size, &type, &flags);
+    if (!data || type != u->atom_Float || size != sizeof(float))
+        return false;
+    *v = *(const float*)data;
+    return true;
+}
+
+
+/**
+* Restores a saved state. It's taken over by the next run(), which starts
+* the delay at full output right away.
+*/
+static LV2_State_Status restore(LV2_Handle instance,
+    LV2_State_Retrieve_Function retrieve, LV2_State_Handle handle,
+    uint32_t flags, const LV2_Feature* const* features) {
+    BollieDelayXT* self = (BollieDelayXT*)instance;
+    const BollieUrids* u = &self->urids;
+    BollieWarm w = { 0 };
+
+    if (!u->atom_Float)
+        return LV2_STATE_ERR_NO_FEATURE;
+
+    retrieve_float(u, retrieve, handle, u->state_hostTempo, &w.host_bpm);
+    if (!retrieve_float(u, retrieve, handle, u->state_delayCh1, &w.d_t_ch1)
+        || !retrieve_float(u, retrieve, handle, u->state_delayCh2,
+            &w.d_t_ch2)
+        || !retrieve_float(u, retrieve, handle, u->state_gainDry,
+            &w.gain_dry)
+        || !retrieve_float(u, retrieve, handle, u->state_gainWet,
+            &w.gain_wet)
+        || !retrieve_float(u, retrieve, handle, u->state_feedback, &w.fb)
+        || !retrieve_float(u, retrieve, handle, u->state_crossfeed, &w.cf))
+        return LV2_STATE_ERR_NO_PROPERTY;
+
+    // Stay within what the buffers can hold
+    float max_d_t = (self->buf_size - self->mod_offset_samples - 1)
+        / self->sample_rate;
+    w.d_t_ch1 = fmaxf(0, fminf(w.d_t_ch1, max_d_t));
+    w.d_t_ch2 = fmaxf(0, fminf(w.d_t_ch2, max_d_t));
+
+    w.valid = true;
+    self->warm = w;
+    return LV2_STATE_SUCCESS;
+}
+
+
+/**
+* Commits the next part of the delay lines, in the worker thread. The
+* contents stay as they are, the audio thread may still be using them.
+*/
+static LV2_Worker_Status work(LV2_Handle instance,
+    LV2_Worker_Respond_Function respond, LV2_Worker_Respond_Handle handle,
+    uint32_t size, const void* data) {
+    BollieDelayXT* self = (BollieDelayXT*)instance;
+    const BollieRingWork* w = (const BollieRingWork*)data;
+    if (size != sizeof(BollieRingWork))
+        return LV2_WORKER_ERR_UNKNOWN;
+
+    // The guard behind the ring has been committed by activate()
+    size_t from = w->from * sizeof(bs_sample);
+    size_t to = w->to * sizeof(bs_sample);
+    for (uint32_t c = 0 ; c < self->channels ; ++c)
+        bm_commit((char*)self->buffer[c] + from, to - from);
+    return respond(handle, size, data);
+}
+
+
+/**
+* Takes the reply of the worker, in the audio thread. Replies to requests
+* from before the last activate() are dropped, the lines have been trimmed
+* since.
+*/
+static LV2_Worker_Status work_response(LV2_Handle instance, uint32_t size,
+    const void* body) {
+    BollieDelayXT* self = (BollieDelayXT*)instance;
+    const BollieRingWork* w = (const BollieRingWork*)body;
+    if (size != sizeof(BollieRingWork) || w->gen != self->ring_gen)
+        return LV2_WORKER_SUCCESS;
+
+    if (w->to > self->ring_ready)
+        self->ring_ready = w->to;
+    self->ring_pending = false;
+    return LV2_WORKER_SUCCESS;
 }
 
 
@@ -839,7 +2816,11 @@ static void deactivate(LV2_Handle instance) {
 * Cleanup, freeing memory and stuff
 */
 static void cleanup(LV2_Handle instance) {
-    free(instance);
+    BollieDelayXT* self = (BollieDelayXT*)instance;
+    size_t line_bytes = (self->buf_size + BUF_GUARD + 1) * sizeof(bs_sample);
+    for (uint32_t c = 0 ; c < self->channels ; ++c)
+        bm_free(self->buffer[c], line_bytes);
+    bm_free(self, sizeof(BollieDelayXT));
 }
 
 
@@ -847,31 +2828,36 @@ static void cleanup(LV2_Handle instance) {
 * extension stuff for additional interfaces
 */
 static const void* extension_data(const char* uri) {
+    static const LV2_State_Interface state = { save, restore };
+    static const LV2_Worker_Interface worker = { work, work_response, NULL };
+    if (!strcmp(uri, LV2_STATE__interface))
+        return &state;
+    if (!strcmp(uri, LV2_WORKER__interface))
+        return &worker;
     return NULL;
 }
 
 
 /**
-* Descriptor linking our methods.
+* Descriptors linking our methods, one per variant in the order of the
+* layouts.
 */
-static const LV2_Descriptor descriptor = {
-    URI,
-    instantiate,
-    connect_port,
-    activate,
-    run,
-    deactivate,
-    cleanup,
-    extension_data
+#define BOLLIE_DESCRIPTOR(uri) { uri, instantiate, connect_port, activate, \
+    run, deactivate, cleanup, extension_data }
+
+static const LV2_Descriptor descriptors[] = {
+    BOLLIE_DESCRIPTOR(PLUGIN_URI),
+    BOLLIE_DESCRIPTOR(PLUGIN_URI_MONO),
+    BOLLIE_DESCRIPTOR(PLUGIN_URI_QUAD),
+    BOLLIE_DESCRIPTOR(PLUGIN_URI_51)
 };
 
 
 /**
-* Symbol export using the descriptor above
+* Symbol export using the descriptors above
 */
 LV2_SYMBOL_EXPORT const LV2_Descriptor* lv2_descriptor(uint32_t index) {
-    switch (index) {
-        case 0:  return &descriptor;
-        default: return NULL;
-    }
+    if (index < sizeof(descriptors) / sizeof(descriptors[0]))
+        return &descriptors[index];
+    return NULL;
 }
@@ -0,0 +1,106 @@
+/**
+    Bollie Delay XT - (c) 2017 Thomas Ebeling https://ca9.eu
+
+    This file is part of bolliedelayxt.lv2
+
+    bolliedelay.lv2 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    bolliedelay.lv2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+* \file bolliedenormal.h
+* \author Bollie (https://ca9.eu)
+* \brief Keeps denormals out of the processing: flush to zero modes of the
+* FPU and explicit flushing of recursive states.
+*/
+
+#ifndef __BOLLIEDENORMAL_H__
+#define __BOLLIEDENORMAL_H__
+
+#include <stdint.h>
+#include <math.h>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+/**
+* Values below this magnitude are treated as silence. That's about -300 dBFS,
+* far away from anything audible but well above the denormal range.
+*/
+#define BDN_TINY 1e-15f
+
+/**
+* Saved floating point control state
+*/
+typedef uintptr_t BollieFpuState;
+
+
+/**
+* Enables flush to zero (and denormals are zero where available) for the
+* calling thread.
+* \return   control state to pass to bdn_leave()
+*/
+static inline BollieFpuState bdn_enter() {
+#if defined(__SSE__)
+    BollieFpuState s = _mm_getcsr();
+#if defined(__SSE2__)
+    _mm_setcsr(s | 0x8040);     // FTZ | DAZ
+#else
+    _mm_setcsr(s | 0x8000);     // FTZ, DAZ isn't there on all SSE1 CPUs
+#endif
+    return s;
+#elif defined(__aarch64__)
+    BollieFpuState s;
+    __asm__ __volatile__("mrs %0, fpcr" : "=r"(s));
+    __asm__ __volatile__("msr fpcr, %0" : : "r"(s | (1 << 24)));   // FZ
+    return s;
+#elif defined(__arm__) && defined(__ARM_FP)
+    uint32_t s;
+    __asm__ __volatile__("vmrs %0, fpscr" : "=r"(s));
+    __asm__ __volatile__("vmsr fpscr, %0" : : "r"(s | (1 << 24))); // FZ
+    return s;
+#else
+    return 0;
+#endif
+}
+
+
+/**
+* Restores the floating point control state of the host.
+* \param s  state returned by bdn_enter()
+*/
+static inline void bdn_leave(BollieFpuState s) {
+#if defined(__SSE__)
+    _mm_setcsr(s);
+#elif defined(__aarch64__)
+    __asm__ __volatile__("msr fpcr, %0" : : "r"(s));
+#elif defined(__arm__) && defined(__ARM_FP)
+    uint32_t v = s;
+    __asm__ __volatile__("vmsr fpscr, %0" : : "r"(v));
+#else
+    (void)s;
+#endif
+}
+
+
+/**
+* Flushes a value to zero, if it is too small to matter.
+* \param v  value
+* \return   v or 0
+*/
+static inline float bdn_flush(float v) {
+    return fabsf(v) < BDN_TINY ? 0.f : v;
+}
+
+#endif
@@ -25,130 +25,203 @@
 */
 
 #include "bolliefilter.h"
+#include "bolliedenormal.h"
 #include <math.h>
+#include <stdbool.h>
 
 /**
-* Initializes a BollieFilter object.
-* \param bf Pointer to a BollieFilter object.
+* Calculates normalized coefficients.
+* \param c      Pointer to the destination
+* \param type   Filter type
+* \param freq   Filter cut off frequency
+* \param Q      Filter quality
+* \param rate   Current sampling rate
 */
-void bf_init(BollieFilter* bf) {
-    for (unsigned int i = 0 ; i < 3 ; ++i) {
-        bf->in_buf[i] = 0;
-        bf->processed_buf[i] = 0;
-    }
-    bf->fill_count = 0;
-    bf->freq = 0;
-    bf->Q = 0;
+static void bf_calc_coeffs(BollieCoeffs* c, BollieFilterType type,
+    const float freq, const float Q, double rate) {
+    double w0 = 2 * PI * freq / rate;
+    double alpha = sin(w0) / (2*Q);
+    double cos_w0 = cos(w0);
+    double a0 = 1 + alpha;
+    double b0 = type == BF_HCF ? (1 - cos_w0) / 2 : (1 + cos_w0) / 2;
+    double b1 = type == BF_HCF ? 1 - cos_w0 : -(1 + cos_w0);
+
+    // Normalize once here, so processing doesn't need any division
+    c->b0 = b0 / a0;
+    c->b1 = b1 / a0;
+    c->b2 = c->b0;
+    c->a1 = -2 * cos_w0 / a0;
+    c->a2 = (1 - alpha) / a0;
+}
+
+
+/**
+* Starts a ramp from the coefficients in use to new target coefficients.
+* \param cur    Pointer to the coefficients in use
+* \param tgt    Pointer to the new target coefficients
+* \param inc    Pointer to the per sample increments
+* \param ramp   Pointer to the number of samples left in the ramp
+* \param n      Length of the ramp in samples
+*/
+static void bf_start_ramp(BollieCoeffs* cur, const BollieCoeffs* tgt,
+    BollieCoeffs* inc, uint32_t* ramp, uint32_t n) {
+    float r = 1.f / (float)n;
+    inc->b0 = (tgt->b0 - cur->b0) * r;
+    inc->b1 = (tgt->b1 - cur->b1) * r;
+    inc->b2 = (tgt->b2 - cur->b2) * r;
+    inc->a1 = (tgt->a1 - cur->a1) * r;
+    inc->a2 = (tgt->a2 - cur->a2) * r;
+    *ramp = n;
 }
 
 
 /**
-* Resets a BollieFilter object.
+* Initializes a BollieFilterBank object.
+* \param bf Pointer to a BollieFilterBank object.
 */
-void bf_reset(BollieFilter* bf) {
-    bf_init(bf);
+void bfb_init(BollieFilterBank* bf) {
+    bf_vec zero = {0};
+    for (int g = 0 ; g < BF_GROUPS ; ++g) {
+        bf->z1[g] = zero;
+        bf->z2[g] = zero;
+    }
+    bf->freq = 0;
+    bf->Q = 0;
+    bf->rate = 0;
+    bf->type = BF_LCF;
+    bf->ramp = 0;
 }
 
 
 /**
-* Processes a frame using a low cut filter.
-* \param in     Input sample
+* Sets the filter parameters of a filter bank for the next block. 
+* Coefficients are only recalculated, if anything has changed, and are then
+* interpolated linearly across the block.
+* \param bf     Pointer to the BollieFilterBank object
+* \param type   Filter type
 * \param freq   Filter cut off frequency
 * \param Q      Filter quality
 * \param rate   Current sampling rate
-* \param bf     Pointer to the BollieFilter object
-* \return       Output sample
-* \todo         Validating parameters
+* \param n      Number of samples in the next block
 */
-float bf_lcf(const float in, const float freq, const float Q, 
-    double rate, BollieFilter* bf) {
-
-    // Precalculate if needed.
-    if (freq != bf->freq || Q != bf->Q || rate != bf->rate) {
-        bf->freq = freq;
-        bf->Q = Q;
-        bf->rate = rate;
-        float w0 = 2 * PI * bf->freq / bf->rate;
-        float alpha = sin(w0) / (2*bf->Q);
-        bf->a0 = 1+alpha;
-        bf->a1 = -2 * cos(w0);
-        bf->a2 = 1-alpha;
-        bf->b0 = (1 + cos(w0)) / 2;
-        bf->b1 = -(1 + cos(w0));
-        bf->b2 = (1 + cos(w0)) / 2; 
+void bfb_set_params(BollieFilterBank* bf, BollieFilterType type, 
+    const float freq, const float Q, double rate, uint32_t n) {
+
+    // Finish a ramp, that has not been consumed completely
+    if (bf->ramp) {
+        bf->cur = bf->tgt;
+        bf->ramp = 0;
     }
 
-    // Filter roll
-    bf->in_buf[2] = bf->in_buf[1];
-    bf->in_buf[1] = bf->in_buf[0];
-    bf->in_buf[0] = in;
+    if (freq == bf->freq && Q == bf->Q && rate == bf->rate
+        && type == bf->type)
+        return;
+
+    bool first = bf->rate == 0;
+    bf->type = type;
+    bf->freq = freq;
+    bf->Q = Q;
+    bf->rate = rate;
+    bf_calc_coeffs(&bf->tgt, type, freq, Q, rate);
+
+    if (first || n == 0)
+        bf->cur = bf->tgt;
+    else
+        bf_start_ramp(&bf->cur, &bf->tgt, &bf->inc, &bf->ramp, n);
+}
 
-    bf->processed_buf[2] = bf->processed_buf[1];
-    bf->processed_buf[1] = bf->processed_buf[0];
 
-    // See if we need to fill the buffers first
-    if (bf->fill_count < 3) {
-        bf->processed_buf[0] = in;
-        bf->fill_count++;
-        return 0;
+/**
+* Runs one vector of a filter bank with constant coefficients. Inlined per
+* number of lanes, so gathering and scattering the lanes gets unrolled.
+* \param bf         Pointer to the BollieFilterBank object
+* \param g          Vector to run
+* \param c          Coefficients
+* \param src        Input samples, one array per lane in use
+* \param dst        Output samples, one array per lane in use
+* \param lanes      Number of lanes in use
+* \param from       First sample
+* \param n          End of the block
+*/
+static inline __attribute__((always_inline)) void bfb_run(
+    BollieFilterBank* bf, uint32_t g, const BollieCoeffs* c,
+    const float* const* src, float* const* dst, uint32_t lanes,
+    uint32_t from, uint32_t n) {
+    const BollieCoeffs k = *c;
+    bf_vec z1 = bf->z1[g];
+    bf_vec z2 = bf->z2[g];
+    for (uint32_t i = from ; i < n ; ++i) {
+        bf_vec x = {0};
+        for (uint32_t l = 0 ; l < lanes ; ++l)
+            x[l] = src[l][i];
+        bf_vec y = k.b0 * x + z1;
+        z1 = k.b1 * x - k.a1 * y + z2;
+        z2 = k.b2 * x - k.a2 * y;
+        for (uint32_t l = 0 ; l < lanes ; ++l)
+            dst[l][i] = y[l];
     }
-
-    return bf->processed_buf[0] =             
-            (bf->b0 / bf->a0 * bf->in_buf[0]) +
-            (bf->b1 / bf->a0 * bf->in_buf[1]) +
-            (bf->b2 / bf->a0 * bf->in_buf[2]) -
-            (bf->a1 / bf->a0 * bf->processed_buf[1]) -
-            (bf->a2 / bf->a0 * bf->processed_buf[2]);
+    bf->z1[g] = z1;
+    bf->z2[g] = z2;
 }
 
 
 /**
-* Processes a frame using a high cut filter.
-* \param in     Input sample
-* \param freq   Filter cut off frequency
-* \param Q      Filter quality
-* \param rate   Current sampling rate
-* \param bf     Pointer to the BollieFilter object
-* \return       Output sample
+* Processes a block of up to BF_CHANNELS channels. While the coefficients
+* ramp, all channels are run frame by frame, then each vector of lanes is
+* run across the rest of the block on its own.
+* \param bf         Pointer to the BollieFilterBank object
+* \param in         Input samples, one array per channel
+* \param out        Output samples, one array per channel, may be in
+* \param channels   Number of channels, not more than BF_CHANNELS
+* \param n          Number of samples
 */
-float bf_hcf(const float in, const float freq, const float Q, 
-    double rate, BollieFilter* bf) {
-
-    // Precalculate if needed.
-    if (freq != bf->freq || Q != bf->Q || rate != bf->rate) {
-        bf->freq = freq;
-        bf->Q = Q;
-        bf->rate = rate;
-        float w0 = 2 * PI * bf->freq / bf->rate;
-        float alpha = sin(w0) / (2*bf->Q);
-        bf->a0 = 1+alpha;
-        bf->a1 = -2 * cos(w0);
-        bf->a2 = 1-alpha;
-        bf->b0 = (1 - cos(w0)) / 2;
-        bf->b1 = 1 - cos(w0);
-        bf->b2 = (1 - cos(w0)) / 2; 
+void bfb_process_block(BollieFilterBank* bf, const float* const* in,
+    float* const* out, uint32_t channels, uint32_t n) {
+    uint32_t i = 0;
+
+    // Ramping part
+    for ( ; i < n && bf->ramp ; ++i) {
+        float x[BF_CHANNELS] = {0};
+        for (uint32_t c = 0 ; c < channels ; ++c)
+            x[c] = in[c][i];
+        bfb_process_frame(bf, x, channels);
+        for (uint32_t c = 0 ; c < channels ; ++c)
+            out[c][i] = x[c];
     }
 
-    // Filter roll
-    bf->in_buf[2] = bf->in_buf[1];
-    bf->in_buf[1] = bf->in_buf[0];
-    bf->in_buf[0] = in;
+    // Steady part
+    const BollieCoeffs c = bf->cur;
+    for (uint32_t g = 0 ; g * BF_LANES < channels ; ++g) {
+        const float* src[BF_LANES];
+        float* dst[BF_LANES];
+        uint32_t lanes = channels - g * BF_LANES;
+        if (lanes > BF_LANES)
+            lanes = BF_LANES;
+        for (uint32_t l = 0 ; l < lanes ; ++l) {
+            src[l] = in[g * BF_LANES + l];
+            dst[l] = out[g * BF_LANES + l];
+        }
+
+        switch (lanes) {
+            case 1:  bfb_run(bf, g, &c, src, dst, 1, i, n); break;
+            case 2:  bfb_run(bf, g, &c, src, dst, 2, i, n); break;
+            case 3:  bfb_run(bf, g, &c, src, dst, 3, i, n); break;
+            default: bfb_run(bf, g, &c, src, dst, 4, i, n); break;
+        }
+    }
+}
 
-    bf->processed_buf[2] = bf->processed_buf[1];
-    bf->processed_buf[1] = bf->processed_buf[0];
 
-    // See if we need to fill the buffers first
-    if (bf->fill_count < 3) {
-        bf->processed_buf[0] = in;
-        bf->fill_count++;
-        return 0;
+/**
+* Flushes filter states, that have decayed below audibility, to zero. Call
+* once per block to keep long tails out of the denormal range.
+* \param bf         Pointer to the BollieFilterBank object
+*/
+void bfb_flush(BollieFilterBank* bf) {
+    for (int g = 0 ; g < BF_GROUPS ; ++g) {
+        for (int i = 0 ; i < BF_LANES ; ++i) {
+            bf->z1[g][i] = bdn_flush(bf->z1[g][i]);
+            bf->z2[g][i] = bdn_flush(bf->z2[g][i]);
+        }
     }
-
-    return bf->processed_buf[0] =             
-            (bf->b0 / bf->a0 * bf->in_buf[0]) +
-            (bf->b1 / bf->a0 * bf->in_buf[1]) +
-            (bf->b2 / bf->a0 * bf->in_buf[2]) -
-            (bf->a1 / bf->a0 * bf->processed_buf[1]) -
-            (bf->a2 / bf->a0 * bf->processed_buf[2]);
 }
-
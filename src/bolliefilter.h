@@ -27,33 +27,118 @@
 #ifndef __BOLLIEFILTER_H__
 #define __BOLLIEFILTER_H__
 
+#include <stdint.h>
+
 #define PI 3.141592
 
 /**
-* Filter struct
+* Number of lanes of a filter vector
 */
-typedef struct bfilter {
-    double  rate;               ///< Current sampling rate
-    float   freq;               ///< cut off frequency
-    float   Q;                  ///< filter quality
-    float   a0;
-    float   a1;
-    float   a2;
+#define BF_LANES 4
+
+/**
+* Number of vectors of a filter bank
+*/
+#define BF_GROUPS 2
+
+/**
+* Number of channels a filter bank can run at once
+*/
+#define BF_CHANNELS (BF_LANES * BF_GROUPS)
+
+/**
+* Vector of BF_LANES floats, mapped to SSE/NEON registers by the compiler
+*/
+typedef float bf_vec __attribute__((vector_size(BF_LANES * sizeof(float))));
+
+/**
+* Filter types
+*/
+typedef enum {
+    BF_LCF,     ///< low cut (high pass)
+    BF_HCF      ///< high cut (low pass)
+} BollieFilterType;
+
+/**
+* Normalized biquad coefficients, a0 is always 1
+*/
+typedef struct bcoeffs {
     float   b0;
     float   b1;
     float   b2;
-    float   in_buf[3];          ///< buffer for incoming samples
-    float   processed_buf[3];   ///< buffer for samples processed by this filter
-    unsigned int fill_count;    ///< fill count for the buffers
-} BollieFilter;
-
-void bf_init(BollieFilter*);
-void bf_reset(BollieFilter*); 
-float bf_lcf(const float in, const float freq, const float Q, 
-    double rate, BollieFilter* bf); 
-
-float bf_hcf(const float in, const float freq, const float Q, 
-    double rate, BollieFilter* bf); 
-    
+    float   a1;
+    float   a2;
+} BollieCoeffs;
+
+/**
+* Filter bank struct, running the same filter on up to BF_CHANNELS channels
+* at once. Channel c is lane c % BF_LANES of vector c / BF_LANES.
+*/
+typedef struct bfilterbank {
+    double  rate;               ///< Current sampling rate
+    float   freq;               ///< cut off frequency
+    float   Q;                  ///< filter quality
+    BollieFilterType type;      ///< type of the filter
+    BollieCoeffs cur;           ///< coefficients in use
+    BollieCoeffs tgt;           ///< coefficients at the end of the ramp
+    BollieCoeffs inc;           ///< per sample increment while ramping
+    uint32_t ramp;              ///< samples left in the current ramp
+    bf_vec  z1[BF_GROUPS];      ///< first state per lane
+    bf_vec  z2[BF_GROUPS];      ///< second state per lane
+} BollieFilterBank;
+
+void bfb_init(BollieFilterBank*);
+void bfb_set_params(BollieFilterBank* bf, BollieFilterType type, 
+    const float freq, const float Q, double rate, uint32_t n);
+void bfb_process_block(BollieFilterBank* bf, const float* const* in,
+    float* const* out, uint32_t channels, uint32_t n);
+void bfb_flush(BollieFilterBank* bf);
+
+
+/**
+* Advances a coefficient ramp by one sample.
+* \param c      Pointer to the coefficients in use
+* \param tgt    Pointer to the coefficients at the end of the ramp
+* \param inc    Pointer to the per sample increments
+* \param ramp   Pointer to the number of samples left in the ramp
+*/
+static inline void bf_ramp_step(BollieCoeffs* c, const BollieCoeffs* tgt,
+    const BollieCoeffs* inc, uint32_t* ramp) {
+    if (--*ramp) {
+        c->b0 += inc->b0;
+        c->b1 += inc->b1;
+        c->b2 += inc->b2;
+        c->a1 += inc->a1;
+        c->a2 += inc->a2;
+    }
+    else {
+        // land exactly on the target
+        *c = *tgt;
+    }
+}
+
+
+/**
+* Processes one frame of a filter bank in place.
+* \param bf         Pointer to the BollieFilterBank object
+* \param x          Samples, one per channel, padded with zeros up to
+*                   BF_CHANNELS
+* \param channels   Number of channels in use
+*/
+static inline void bfb_process_frame(BollieFilterBank* bf, float* x,
+    uint32_t channels) {
+    const BollieCoeffs* c = &bf->cur;
+    for (uint32_t g = 0 ; g * BF_LANES < channels ; ++g) {
+        bf_vec in;
+        __builtin_memcpy(&in, x + g * BF_LANES, sizeof(in));
+        bf_vec out = c->b0 * in + bf->z1[g];
+        bf->z1[g] = c->b1 * in - c->a1 * out + bf->z2[g];
+        bf->z2[g] = c->b2 * in - c->a2 * out;
+        __builtin_memcpy(x + g * BF_LANES, &out, sizeof(out));
+    }
+    if (bf->ramp)
+        bf_ramp_step(&bf->cur, &bf->tgt, &bf->inc, &bf->ramp);
+}
+
 
 #endif
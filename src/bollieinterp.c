@@ -0,0 +1,260 @@
+/**
+    Bollie Delay XT - (c) 2017 Thomas Ebeling https://ca9.eu
+
+    This file is part of bolliedelayxt.lv2
+
+    bolliedelay.lv2 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    bolliedelay.lv2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+* \file bollieinterp.c
+* \author Bollie (https://ca9.eu)
+* \brief Fractional delay line reads with selectable interpolation kernels.
+*/
+
+#include "bollieinterp.h"
+#include <pthread.h>
+
+float bi_hermite[BI_PHASES + 1][4];
+float bi_lagrange4[BI_PHASES + 1][4];
+float bi_lagrange6[BI_PHASES + 1][6];
+float bi_allpass[BI_PHASES + 1];
+
+static pthread_once_t bi_once = PTHREAD_ONCE_INIT;
+
+
+/**
+* Calculates the Lagrange weights for the taps -(n/2-1) .. n/2
+* \param w      destination
+* \param n      number of taps
+* \param t      fraction between tap 0 and 1
+*/
+static void bi_calc_lagrange(float* w, int n, double t) {
+    int first = -(n/2 - 1);
+    for (int k = 0 ; k < n ; ++k) {
+        double c = 1;
+        for (int j = 0 ; j < n ; ++j) {
+            if (j != k)
+                c *= (t - (first + j)) / (double)(k - j);
+        }
+        w[k] = c;
+    }
+}
+
+
+/**
+* Fills the coefficient tables
+*/
+static void bi_fill_tables(void) {
+    for (int p = 0 ; p <= BI_PHASES ; ++p) {
+        double t = p / (double)BI_PHASES;
+        double t2 = t * t;
+        double t3 = t2 * t;
+
+        bi_hermite[p][0] = -0.5 * t + t2 - 0.5 * t3;
+        bi_hermite[p][1] = 1 - 2.5 * t2 + 1.5 * t3;
+        bi_hermite[p][2] = 0.5 * t + 2 * t2 - 1.5 * t3;
+        bi_hermite[p][3] = -0.5 * t2 + 0.5 * t3;
+
+        bi_calc_lagrange(bi_lagrange4[p], 4, t);
+        bi_calc_lagrange(bi_lagrange6[p], 6, t);
+
+        // Fractional delay of the allpass between 1.5 and 0.5 samples
+        double delta = 1.5 - t;
+        bi_allpass[p] = (1 - delta) / (1 + delta);
+    }
+}
+
+
+/**
+* Initializes the coefficient tables. Safe to be called from several
+* threads, the tables are only filled once per process.
+*/
+void bi_init(void) {
+    pthread_once(&bi_once, bi_fill_tables);
+}
+
+
+/**
+* Primes an allpass interpolator, so it can take over from another kernel
+* without starting from silence.
+* \param ap     allpass state of the read head
+* \param buf    pointer to the ring
+* \param size   size of the ring in samples, power of two
+* \param x      sample coordinate of the next read
+*/
+void bi_allpass_prime(BollieAllpass* ap, const bs_sample* buf,
+    int32_t size, double x) {
+    int32_t r = (int32_t)(x + size + 1.5);
+    ap->x1 = bs_load(buf[(r - 1) & (size - 1)]);
+    ap->y1 = bi_read_linear(buf, size, x - 1);
+}
+
+
+/**
+* Number of consecutive samples read at once by the table kernels
+*/
+#define BI_LANES 4
+
+/**
+* Vectors of BI_LANES values
+*/
+typedef float bi_vec __attribute__((vector_size(BI_LANES * sizeof(float))));
+typedef int32_t bi_ivec
+    __attribute__((vector_size(BI_LANES * sizeof(int32_t))));
+
+#ifdef __clang__
+#define BI_SHUFFLE(a, b, ...) __builtin_shufflevector(a, b, __VA_ARGS__)
+#else
+#define BI_SHUFFLE(a, b, ...) __builtin_shuffle(a, b, (bi_ivec){__VA_ARGS__})
+#endif
+
+
+/**
+* Reads BI_LANES consecutive samples of a block with a table kernel. Per
+* sample, the first 4 coefficients and the samples they weight are loaded
+* as a vector and multiplied at once. The 4 products are then transposed
+* and summed, so each lane ends up with the sum of its sample. The 6 point
+* kernel adds its last 2 taps on top. The positions and the loads are
+* scalar, SSE2 and NEON have no gather.
+* \param q      table kernel, BI_HERMITE, BI_LAGRANGE4 or BI_LAGRANGE6
+* \param buf    pointer to the ring
+* \param size   size of the ring in samples, power of two
+* \param pos    write position of the first sample
+* \param d      delay time of each sample in samples
+* \param mod    modulation offset of each sample in samples
+* \return       interpolated samples
+*/
+static inline __attribute__((always_inline)) bi_vec bi_read_lanes(
+    BollieInterp q, const bs_sample* buf, int32_t size, int32_t pos,
+    const float* d, const float* mod) {
+    const int32_t mask = size - 1;
+    const float (*tab)[4] = q == BI_LAGRANGE4 ? bi_lagrange4 : bi_hermite;
+    double x[BI_LANES];
+    int32_t x0[BI_LANES], ph[BI_LANES];
+    bi_vec p[BI_LANES], t = {0};
+
+    // positions of all lanes first, then their loads
+    for (int l = 0 ; l < BI_LANES ; ++l)
+        x[l] = (double)(pos + l) - d[l] + mod[l] + size;
+    for (int l = 0 ; l < BI_LANES ; ++l)
+        x0[l] = (int32_t)x[l];
+    for (int l = 0 ; l < BI_LANES ; ++l)
+        ph[l] = (int32_t)((x[l] - (double)x0[l]) * BI_PHASES + 0.5);
+
+    for (int l = 0 ; l < BI_LANES ; ++l) {
+        bi_vec c, v;
+        if (q == BI_LAGRANGE6) {
+            const float* k = bi_lagrange6[ph[l]];
+            const bs_sample* s = buf + ((x0[l] - 2) & mask);
+            __builtin_memcpy(&c, k, sizeof(c));
+            bs_load4(s, (float*)&v);
+            t[l] = k[4] * bs_load(s[4]) + k[5] * bs_load(s[5]);
+        }
+        else {
+            __builtin_memcpy(&c, tab[ph[l]], sizeof(c));
+            bs_load4(buf + ((x0[l] - 1) & mask), (float*)&v);
+        }
+        p[l] = c * v;
+    }
+
+    bi_vec a = BI_SHUFFLE(p[0], p[1], 0, 4, 1, 5)
+        + BI_SHUFFLE(p[0], p[1], 2, 6, 3, 7);
+    bi_vec b = BI_SHUFFLE(p[2], p[3], 0, 4, 1, 5)
+        + BI_SHUFFLE(p[2], p[3], 2, 6, 3, 7);
+    return BI_SHUFFLE(a, b, 0, 1, 4, 5) + BI_SHUFFLE(a, b, 2, 3, 6, 7) + t;
+}
+
+
+/**
+* Block loop of a table kernel, inlined once per kernel. The samples are
+* read BI_LANES at a time, the rest one by one.
+*/
+static inline __attribute__((always_inline)) void bi_gather_table(
+    BollieInterp q, const bs_sample* buf, int32_t size, int32_t pos,
+    const float* d, const float* mod, float* out, uint32_t n) {
+    uint32_t i = 0;
+    for ( ; i + BI_LANES <= n ; i += BI_LANES) {
+        bi_vec y = bi_read_lanes(q, buf, size, pos + (int32_t)i, d + i,
+            mod + i);
+        __builtin_memcpy(out + i, &y, sizeof(y));
+    }
+    for ( ; i < n ; ++i)
+        out[i] = bi_read(q, buf, size,
+            (double)(pos + (int32_t)i) - d[i] + mod[i], NULL);
+}
+
+
+/**
+* Reads a block of samples from a ring. The read position of sample i is
+* pos + i - d[i] + mod[i]. The table kernels are read BI_LANES samples at a
+* time. Linear reads and the allpass, which depends on its previous output,
+* stay scalar, one sample after the other.
+* \param q      interpolation kernel
+* \param buf    pointer to the ring
+* \param size   size of the ring in samples, power of two
+* \param pos    write position of the first sample
+* \param d      delay times in samples
+* \param mod    modulation offsets in samples
+* \param out    destination
+* \param n      number of samples
+* \param ap     allpass state of this read head
+*/
+void bi_gather(BollieInterp q, const bs_sample* buf, int32_t size,
+    int32_t pos, const float* d, const float* mod, float* out, uint32_t n,
+    BollieAllpass* ap) {
+    switch (q) {
+        case BI_HERMITE:
+            bi_gather_table(BI_HERMITE, buf, size, pos, d, mod, out, n);
+            break;
+        case BI_LAGRANGE4:
+            bi_gather_table(BI_LAGRANGE4, buf, size, pos, d, mod, out, n);
+            break;
+        case BI_LAGRANGE6:
+            bi_gather_table(BI_LAGRANGE6, buf, size, pos, d, mod, out, n);
+            break;
+        case BI_ALLPASS:
+            for (uint32_t i = 0 ; i < n ; ++i)
+                out[i] = bi_read_allpass(buf, size,
+                    (double)(pos + (int32_t)i) - d[i] + mod[i], ap);
+            break;
+        default:
+            for (uint32_t i = 0 ; i < n ; ++i)
+                out[i] = bi_read_linear(buf, size,
+                    (double)(pos + (int32_t)i) - d[i] + mod[i]);
+            break;
+    }
+}
+
+
+/**
+* Reads a block of samples at a whole number of samples delay, which needs
+* no interpolation. All kernels but the allpass return the samples
+* themselves there.
+* \param buf    pointer to the ring
+* \param size   size of the ring in samples, power of two
+* \param x      sample coordinate of the first sample. Can be negative, but
+*               not below -size.
+* \param out    destination
+* \param n      number of samples, not more than size
+*/
+void bi_copy(const bs_sample* buf, int32_t size, int32_t x, float* out,
+    uint32_t n) {
+    uint32_t r = (uint32_t)(x + size) & (size - 1);
+    uint32_t m = size - r < n ? size - r : n;
+    for (uint32_t i = 0 ; i < m ; ++i)
+        out[i] = bs_load(buf[r + i]);
+    for (uint32_t i = m ; i < n ; ++i)
+        out[i] = bs_load(buf[i - m]);
+}
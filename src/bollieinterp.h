@@ -0,0 +1,189 @@
+/**
+    Bollie Delay XT - (c) 2017 Thomas Ebeling https://ca9.eu
+
+    This file is part of bolliedelayxt.lv2
+
+    bolliedelay.lv2 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    bolliedelay.lv2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+* \file bollieinterp.h
+* \author Bollie (https://ca9.eu)
+* \brief Fractional delay line reads with selectable interpolation kernels.
+*
+* All reads expect a ring buffer with a power of two size, followed by a
+* guard region mirroring at least the first BI_GUARD_NEEDED samples.
+*/
+
+#ifndef __BOLLIEINTERP_H__
+#define __BOLLIEINTERP_H__
+
+#include <stdint.h>
+#include "bolliestorage.h"
+
+/**
+* Number of quantized fractions of the coefficient tables
+*/
+#define BI_PHASES 1024
+
+/**
+* Samples a read may access past the end of the ring
+*/
+#define BI_GUARD_NEEDED 5
+
+/**
+* Interpolation kernels, values match the quality control port
+*/
+typedef enum {
+    BI_LINEAR,      ///< 2 point linear
+    BI_HERMITE,     ///< 4 point cubic Hermite (Catmull-Rom)
+    BI_LAGRANGE4,   ///< 4 point Lagrange
+    BI_LAGRANGE6,   ///< 6 point Lagrange
+    BI_ALLPASS      ///< first order Thiran allpass, static delays only
+} BollieInterp;
+
+/**
+* State of an allpass interpolator, one per read head
+*/
+typedef struct ballpass {
+    float   x1;                 ///< last input
+    float   y1;                 ///< last output
+} BollieAllpass;
+
+extern float bi_hermite[BI_PHASES + 1][4];
+extern float bi_lagrange4[BI_PHASES + 1][4];
+extern float bi_lagrange6[BI_PHASES + 1][6];
+extern float bi_allpass[BI_PHASES + 1];
+
+void bi_init(void);
+void bi_allpass_prime(BollieAllpass* ap, const bs_sample* buf,
+    int32_t size, double x);
+void bi_gather(BollieInterp q, const bs_sample* buf, int32_t size,
+    int32_t pos, const float* d, const float* mod, float* out, uint32_t n,
+    BollieAllpass* ap);
+void bi_copy(const bs_sample* buf, int32_t size, int32_t x, float* out,
+    uint32_t n);
+
+
+/**
+* Linear interpolation
+* \param buf    pointer to the ring
+* \param size   size of the ring in samples, power of two
+* \param x      sample coordinate. Can be negative, but not below -size.
+* \return       interpolated sample
+*/
+static inline float bi_read_linear(const bs_sample* buf, int32_t size,
+    double x) {
+    x += size;
+    int32_t x0 = (int32_t)x;
+    float frac = x - (double)x0;
+    x0 &= size - 1;
+    // buf[size] mirrors buf[0], so x0 + 1 never needs wrapping
+    float s0 = bs_load(buf[x0]);
+    return s0 + frac * (bs_load(buf[x0 + 1]) - s0);
+}
+
+
+/**
+* 4 point interpolation using a coefficient table
+* \param buf    pointer to the ring
+* \param size   size of the ring in samples, power of two
+* \param x      sample coordinate. Can be negative, but not below -size.
+* \param tab    coefficient table, indexed by the quantized fraction
+* \return       interpolated sample
+*/
+static inline float bi_read_4(const bs_sample* buf, int32_t size, double x,
+    const float (*tab)[4]) {
+    x += size;
+    int32_t x0 = (int32_t)x;
+    const float* c = tab[(int32_t)((x - (double)x0) * BI_PHASES + 0.5)];
+    float s[4];
+    bs_load4(buf + ((x0 - 1) & (size - 1)), s);
+    return c[0] * s[0] + c[1] * s[1] + c[2] * s[2] + c[3] * s[3];
+}
+
+
+/**
+* 6 point interpolation using a coefficient table
+* \param buf    pointer to the ring
+* \param size   size of the ring in samples, power of two
+* \param x      sample coordinate. Can be negative, but not below -size.
+* \param tab    coefficient table, indexed by the quantized fraction
+* \return       interpolated sample
+*/
+static inline float bi_read_6(const bs_sample* buf, int32_t size, double x,
+    const float (*tab)[6]) {
+    x += size;
+    int32_t x0 = (int32_t)x;
+    const float* c = tab[(int32_t)((x - (double)x0) * BI_PHASES + 0.5)];
+    const bs_sample* s = buf + ((x0 - 2) & (size - 1));
+    float v[6];
+    bs_load4(s, v);
+    v[4] = bs_load(s[4]);
+    v[5] = bs_load(s[5]);
+    return c[0] * v[0] + c[1] * v[1] + c[2] * v[2] + c[3] * v[3]
+        + c[4] * v[4] + c[5] * v[5];
+}
+
+
+/**
+* Allpass interpolation. The integer part is read from the ring, the
+* fractional part (between 0.5 and 1.5 samples) is delayed by a first order
+* Thiran allpass. Only suitable for consecutive reads of a slowly changing
+* delay.
+* \param buf    pointer to the ring
+* \param size   size of the ring in samples, power of two
+* \param x      sample coordinate. Can be negative, but not below -size.
+* \param ap     allpass state of this read head
+* \return       interpolated sample
+*/
+static inline float bi_read_allpass(const bs_sample* buf, int32_t size,
+    double x, BollieAllpass* ap) {
+    x += size + 1.5;
+    int32_t r = (int32_t)x;
+    float a = bi_allpass[(int32_t)((x - (double)r) * BI_PHASES + 0.5)];
+    float in = bs_load(buf[r & (size - 1)]);
+    float y = a * (in - ap->y1) + ap->x1;
+    ap->x1 = in;
+    ap->y1 = y;
+    return y;
+}
+
+
+/**
+* Reads a sample using the given kernel
+* \param q      interpolation kernel
+* \param buf    pointer to the ring
+* \param size   size of the ring in samples, power of two
+* \param x      sample coordinate. Can be negative, but not below -size.
+* \param ap     allpass state of this read head
+* \return       interpolated sample
+*/
+static inline float bi_read(BollieInterp q, const bs_sample* buf,
+    int32_t size, double x, BollieAllpass* ap) {
+    switch (q) {
+        case BI_HERMITE:
+            return bi_read_4(buf, size, x, bi_hermite);
+        case BI_LAGRANGE4:
+            return bi_read_4(buf, size, x, bi_lagrange4);
+        case BI_LAGRANGE6:
+            return bi_read_6(buf, size, x, bi_lagrange6);
+        case BI_ALLPASS:
+            return bi_read_allpass(buf, size, x, ap);
+        default:
+            return bi_read_linear(buf, size, x);
+    }
+}
+
+#endif
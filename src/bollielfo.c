@@ -0,0 +1,120 @@
+/**
+    Bollie Delay XT - (c) 2017 Thomas Ebeling https://ca9.eu
+
+    This file is part of bolliedelayxt.lv2
+
+    bolliedelay.lv2 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    bolliedelay.lv2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+* \file bollielfo.c
+* \author Bollie (https://ca9.eu)
+* \brief Low frequency oscillator with quadrature output.
+*/
+
+#include "bollielfo.h"
+#include <math.h>
+
+/**
+* Initializes a BollieLfo object.
+* \param lfo    Pointer to a BollieLfo object.
+* \param rate   Current sampling rate
+*/
+void bl_init(BollieLfo* lfo, double rate) {
+    lfo->rate = rate;
+    lfo->freq = 0;
+    lfo->shape = BL_SINE;
+    lfo->rot_s = 0;
+    lfo->rot_c = 1;
+    lfo->incr = 0;
+    lfo->seed = 1;
+    bl_reset(lfo);
+}
+
+
+/**
+* Resets the phase of a BollieLfo object to zero.
+* \param lfo    Pointer to a BollieLfo object.
+*/
+void bl_reset(BollieLfo* lfo) {
+    lfo->s = 0;
+    lfo->c = 1;
+    lfo->phase = 0;
+    lfo->r_from[0] = 0;
+    lfo->r_from[1] = 0;
+    lfo->r_to[0] = bl_random(lfo);
+    lfo->r_to[1] = bl_random(lfo);
+}
+
+
+/**
+* Sets shape and frequency. The increments are only recalculated on change.
+* \param lfo    Pointer to a BollieLfo object.
+* \param shape  LFO shape
+* \param freq   Frequency in Hz
+*/
+void bl_set(BollieLfo* lfo, BollieLfoShape shape, float freq) {
+    lfo->shape = shape;
+    if (freq == lfo->freq)
+        return;
+
+    lfo->freq = freq;
+    double w = 2 * M_PI * freq / lfo->rate;
+    lfo->rot_s = sin(w);
+    lfo->rot_c = cos(w);
+    lfo->incr = freq / lfo->rate;
+}
+
+
+/**
+* Pulls the amplitude of the sine oscillator back to one. The recursion
+* drifts slowly due to rounding, calling this once per block is plenty.
+* \param lfo    Pointer to a BollieLfo object.
+*/
+void bl_renormalize(BollieLfo* lfo) {
+    float g = 1.5f - 0.5f * (lfo->s * lfo->s + lfo->c * lfo->c);
+    lfo->s *= g;
+    lfo->c *= g;
+}
+
+
+/**
+* Runs the LFO for a block.
+* \param lfo    Pointer to a BollieLfo object.
+* \param v      destination for the main output
+* \param q      destination for the quadrature output
+* \param n      number of samples
+*/
+void bl_process_block(BollieLfo* lfo, float* v, float* q, uint32_t n) {
+    if (lfo->shape == BL_SINE) {
+        float s = lfo->s;
+        float c = lfo->c;
+        const float rs = lfo->rot_s;
+        const float rc = lfo->rot_c;
+        for (uint32_t i = 0 ; i < n ; ++i) {
+            v[i] = s;
+            q[i] = c;
+            float t = s;
+            s = t * rc + c * rs;
+            c = c * rc - t * rs;
+        }
+        lfo->s = s;
+        lfo->c = c;
+    }
+    else {
+        for (uint32_t i = 0 ; i < n ; ++i)
+            bl_tick(lfo, &v[i], &q[i]);
+    }
+    bl_renormalize(lfo);
+}
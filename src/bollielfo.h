@@ -0,0 +1,131 @@
+/**
+    Bollie Delay XT - (c) 2017 Thomas Ebeling https://ca9.eu
+
+    This file is part of bolliedelayxt.lv2
+
+    bolliedelay.lv2 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    bolliedelay.lv2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+* \file bollielfo.h
+* \author Bollie (https://ca9.eu)
+* \brief Low frequency oscillator with quadrature output.
+*
+* Every shape provides a main output and a quadrature output running a
+* quarter period ahead, so any phase offset can be derived by rotation.
+*/
+
+#ifndef __BOLLIELFO_H__
+#define __BOLLIELFO_H__
+
+#include <stdint.h>
+
+/**
+* LFO shapes, values match the shape control port
+*/
+typedef enum {
+    BL_SINE,        ///< sine, recursive quadrature oscillator
+    BL_TRIANGLE,    ///< triangle
+    BL_RANDOM       ///< smoothed random steps, one per period
+} BollieLfoShape;
+
+/**
+* LFO struct
+*/
+typedef struct blfo {
+    double  rate;               ///< Current sampling rate
+    float   freq;               ///< frequency in Hz
+    BollieLfoShape shape;       ///< current shape
+    float   s;                  ///< sine oscillator, main output
+    float   c;                  ///< sine oscillator, quadrature output
+    float   rot_s;              ///< sine of the phase increment
+    float   rot_c;              ///< cosine of the phase increment
+    float   phase;              ///< phase of triangle and random, 0..1
+    float   incr;               ///< phase increment per sample
+    uint32_t seed;              ///< state of the random generator
+    float   r_from[2];          ///< random steps, main and quadrature
+    float   r_to[2];
+} BollieLfo;
+
+void bl_init(BollieLfo* lfo, double rate);
+void bl_reset(BollieLfo* lfo);
+void bl_set(BollieLfo* lfo, BollieLfoShape shape, float freq);
+void bl_renormalize(BollieLfo* lfo);
+void bl_process_block(BollieLfo* lfo, float* v, float* q, uint32_t n);
+
+
+/**
+* Draws the next random value between -1 and 1
+* \param lfo    Pointer to the BollieLfo object
+* \return       random value
+*/
+static inline float bl_random(BollieLfo* lfo) {
+    lfo->seed = lfo->seed * 1664525u + 1013904223u;
+    return (float)(lfo->seed >> 8) * (2.f / 16777216.f) - 1.f;
+}
+
+
+/**
+* Triangle with the phase relation of a sine
+* \param p      phase, 0..2
+* \return       value between -1 and 1
+*/
+static inline float bl_triangle(float p) {
+    p += 0.75f;
+    p -= (int32_t)p;
+    return 4.f * (p > 0.5f ? p - 0.5f : 0.5f - p) - 1.f;
+}
+
+
+/**
+* Advances the LFO by one sample.
+* \param lfo    Pointer to the BollieLfo object
+* \param v      destination for the main output
+* \param q      destination for the quadrature output
+*/
+static inline void bl_tick(BollieLfo* lfo, float* v, float* q) {
+    switch (lfo->shape) {
+        case BL_TRIANGLE:
+            *v = bl_triangle(lfo->phase);
+            *q = bl_triangle(lfo->phase + 0.25f);
+            lfo->phase += lfo->incr;
+            lfo->phase -= lfo->phase >= 1.f ? 1.f : 0;
+            break;
+        case BL_RANDOM: {
+            float p = lfo->phase;
+            float k = p * p * (3.f - 2.f * p);
+            *v = lfo->r_from[0] + k * (lfo->r_to[0] - lfo->r_from[0]);
+            *q = lfo->r_from[1] + k * (lfo->r_to[1] - lfo->r_from[1]);
+            lfo->phase += lfo->incr;
+            if (lfo->phase >= 1.f) {
+                lfo->phase -= 1.f;
+                lfo->r_from[0] = lfo->r_to[0];
+                lfo->r_from[1] = lfo->r_to[1];
+                lfo->r_to[0] = bl_random(lfo);
+                lfo->r_to[1] = bl_random(lfo);
+            }
+            break;
+        }
+        default: {
+            *v = lfo->s;
+            *q = lfo->c;
+            float s = lfo->s;
+            lfo->s = s * lfo->rot_c + lfo->c * lfo->rot_s;
+            lfo->c = lfo->c * lfo->rot_c - s * lfo->rot_s;
+            break;
+        }
+    }
+}
+
+#endif
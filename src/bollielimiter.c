@@ -0,0 +1,240 @@
+/**
+    Bollie Delay XT - (c) 2017 Thomas Ebeling https://ca9.eu
+
+    This file is part of bolliedelayxt.lv2
+
+    bolliedelay.lv2 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    bolliedelay.lv2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+* \file bollielimiter.c
+* \author Bollie (https://ca9.eu)
+* \brief Peak limiter of the feedback path, for up to BF_CHANNELS channels.
+*/
+
+#include <math.h>
+#include "bollielimiter.h"
+#include "bolliedenormal.h"
+
+
+/**
+* Initializes a limiter, unlinked and without lookahead.
+* \param lim pointer to the limiter
+* \param rate sample rate
+* \param channels number of channels, not more than BF_CHANNELS
+* \param attack_ms time for the envelope to rise by 40 dB
+* \param release_ms time for the envelope to fall by 40 dB
+*/
+void blm_init(BollieLimiter* lim, double rate, uint32_t channels,
+    float attack_ms, float release_ms) {
+    memset(lim, 0, sizeof(BollieLimiter));
+    lim->rate = rate;
+    lim->channels = channels;
+    lim->attack_free = powf(0.01f, 1.0f / (attack_ms * rate * 0.001f));
+    lim->attack = lim->attack_free;
+    lim->release = powf(0.01f, 1.0f / (release_ms * rate * 0.001f));
+}
+
+
+/**
+* Sets the mode and the lookahead. A changed lookahead starts from silent
+* lines, as they only hold the samples of the previous lookahead.
+* \param lim pointer to the limiter
+* \param linked true to follow the loudest channel on all channels
+* \param lookahead_ms lookahead, up to BLM_LOOKAHEAD_MS
+*/
+void blm_set(BollieLimiter* lim, bool linked, float lookahead_ms) {
+    if (linked && !lim->linked) {
+        // Start from the loudest channel
+        float env = 0;
+        for (uint32_t c = 0 ; c < lim->channels ; ++c)
+            env = fmaxf(env, lim->env[c]);
+        for (uint32_t c = 0 ; c < lim->channels ; ++c)
+            lim->env[c] = env;
+    }
+    lim->linked = linked;
+
+    float ms = fminf(fmaxf(lookahead_ms, 0), BLM_LOOKAHEAD_MS);
+    uint32_t la = (uint32_t)(ms * lim->rate * 0.001 + 0.5);
+    if (la > BLM_LINE - 1)
+        la = BLM_LINE - 1;
+    if (la != lim->la) {
+        memset(lim->line, 0, sizeof(lim->line));
+        lim->la = la;
+        lim->attack = la ? fminf(lim->attack_free, powf(0.01f, 1.0f / la))
+            : lim->attack_free;
+    }
+}
+
+
+/**
+* Resets the envelopes and the part of the lookahead lines, that is still
+* to be played.
+* \param lim pointer to the limiter
+*/
+void blm_reset(BollieLimiter* lim) {
+    for (uint32_t c = 0 ; c < BF_CHANNELS ; ++c) {
+        lim->env[c] = 0;
+        for (uint32_t i = 1 ; i <= lim->la ; ++i)
+            lim->line[c][(lim->la_pos - i) & (BLM_LINE - 1)] = 0;
+    }
+}
+
+
+/**
+* Flushes denormals out of the envelopes, which decay towards zero.
+* \param lim pointer to the limiter
+*/
+void blm_flush(BollieLimiter* lim) {
+    for (uint32_t c = 0 ; c < lim->channels ; ++c)
+        lim->env[c] = bdn_flush(lim->env[c]);
+}
+
+
+/**
+* Runs the envelopes of up to BF_LANES channels side by side, one vector
+* lane per channel, and keeps them as gain for the second pass. The
+* envelopes are independent recursions, so running them in lanes hides
+* their latency. Inlined per number of lanes.
+* \param lim pointer to the limiter
+* \param x samples of the channels
+* \param first first channel
+* \param lanes number of channels
+* \param from first sample
+* \param n number of samples, not more than BLM_CHUNK
+*/
+static inline __attribute__((always_inline)) void follow_lanes(
+    BollieLimiter* lim, float* const* x, uint32_t first, uint32_t lanes,
+    uint32_t from, uint32_t n) {
+    const bf_ivec abs_mask = (bf_ivec){0} + 0x7fffffff;
+    bf_vec env = {0};
+    for (uint32_t l = 0 ; l < lanes ; ++l)
+        env[l] = lim->env[first + l];
+
+    for (uint32_t i = 0 ; i < n ; ++i) {
+        bf_vec v = {0};
+        for (uint32_t l = 0 ; l < lanes ; ++l)
+            v[l] = x[first + l][from + i];
+        env = blm_follow(lim, env, (bf_vec)((bf_ivec)v & abs_mask));
+        for (uint32_t l = 0 ; l < lanes ; ++l)
+            lim->gain[first + l][i] = env[l];
+    }
+
+    for (uint32_t l = 0 ; l < lanes ; ++l)
+        lim->env[first + l] = env[l];
+}
+
+
+/**
+* Runs the envelope of the loudest channel and keeps it as gain of the
+* first channel for the second pass.
+* \param lim pointer to the limiter
+* \param x samples of the channels
+* \param from first sample
+* \param n number of samples, not more than BLM_CHUNK
+*/
+static void follow_linked(BollieLimiter* lim, float* const* x, uint32_t from,
+    uint32_t n) {
+    float *g = lim->gain[0];
+    for (uint32_t i = 0 ; i < n ; ++i)
+        g[i] = fabsf(x[0][from + i]);
+    for (uint32_t c = 1 ; c < lim->channels ; ++c) {
+        const float *s = x[c] + from;
+        for (uint32_t i = 0 ; i < n ; ++i)
+            g[i] = fmaxf(g[i], fabsf(s[i]));
+    }
+
+    const float attack = lim->attack;
+    const float release = lim->release;
+    float env = lim->env[0];
+    for (uint32_t i = 0 ; i < n ; ++i) {
+        float v = g[i];
+        env = (v > env ? attack : release) * (env - v) + v;
+        g[i] = env;
+    }
+    for (uint32_t c = 0 ; c < lim->channels ; ++c)
+        lim->env[c] = env;
+}
+
+
+/**
+* Applies the gain of one channel, BF_LANES samples at a time.
+* \param x samples, limited in place
+* \param env envelope of each sample
+* \param n number of samples
+*/
+static void apply(float* x, const float* env, uint32_t n) {
+    uint32_t i = 0;
+    for ( ; i + BF_LANES <= n ; i += BF_LANES) {
+        bf_vec s, e;
+        memcpy(&s, x + i, sizeof(bf_vec));
+        memcpy(&e, env + i, sizeof(bf_vec));
+        s = blm_apply(s, e);
+        memcpy(x + i, &s, sizeof(bf_vec));
+    }
+    if (i < n) {
+        bf_vec s = {0}, e = {0};
+        memcpy(&s, x + i, (n - i) * sizeof(float));
+        memcpy(&e, env + i, (n - i) * sizeof(float));
+        s = blm_apply(s, e);
+        memcpy(x + i, &s, (n - i) * sizeof(float));
+    }
+}
+
+
+/**
+* Limits a block in place. The envelopes of a chunk are run first, then the
+* gain is applied to each channel as a whole.
+* \param lim pointer to the limiter
+* \param x samples of each channel
+* \param n number of samples
+*/
+void blm_process_block(BollieLimiter* lim, float* const* x, uint32_t n) {
+    const uint32_t channels = lim->channels;
+    for (uint32_t from = 0 ; from < n ; from += BLM_CHUNK) {
+        uint32_t m = n - from < BLM_CHUNK ? n - from : BLM_CHUNK;
+
+        if (lim->linked) {
+            follow_linked(lim, x, from, m);
+        }
+        else {
+            for (uint32_t c = 0 ; c < channels ; c += BF_LANES) {
+                switch (channels - c) {
+                    case 1:  follow_lanes(lim, x, c, 1, from, m); break;
+                    case 2:  follow_lanes(lim, x, c, 2, from, m); break;
+                    case 3:  follow_lanes(lim, x, c, 3, from, m); break;
+                    default: follow_lanes(lim, x, c, 4, from, m); break;
+                }
+            }
+        }
+
+        for (uint32_t c = 0 ; c < channels ; ++c) {
+            float *s = x[c] + from;
+
+            // The signal comes out of the lookahead line, behind its envelope
+            if (lim->la) {
+                float *line = lim->line[c];
+                uint32_t w = lim->la_pos;
+                for (uint32_t i = 0 ; i < m ; ++i) {
+                    line[w] = s[i];
+                    s[i] = line[(w - lim->la) & (BLM_LINE - 1)];
+                    w = (w + 1) & (BLM_LINE - 1);
+                }
+            }
+
+            apply(s, lim->gain[lim->linked ? 0 : c], m);
+        }
+        lim->la_pos = (lim->la_pos + (lim->la ? m : 0)) & (BLM_LINE - 1);
+    }
+}
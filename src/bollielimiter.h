@@ -0,0 +1,189 @@
+/**
+    Bollie Delay XT - (c) 2017 Thomas Ebeling https://ca9.eu
+
+    This file is part of bolliedelayxt.lv2
+
+    bolliedelay.lv2 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    bolliedelay.lv2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+* \file bollielimiter.h
+* \author Bollie (https://ca9.eu)
+* \brief Peak limiter of the feedback path, for up to BF_CHANNELS channels.
+*
+* An envelope follower per channel, or one for all channels when linked,
+* scales the signal down as soon as the envelope exceeds unity. The gain is
+* a reciprocal of the envelope, computed with Newton steps instead of a
+* divide and selected with masks, so limiting costs the same as passing the
+* signal through. The optional lookahead delays the signal behind its
+* envelope by up to BLM_LOOKAHEAD_MS, and the envelope rises within the
+* lookahead, so peaks are caught before they pass.
+*/
+
+#ifndef __BOLLIELIMITER_H__
+#define __BOLLIELIMITER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "bolliefilter.h"
+
+/**
+* Longest lookahead in ms
+*/
+#define BLM_LOOKAHEAD_MS 2.f
+
+/**
+* Length of the lookahead lines, a power of two, enough for the longest
+* lookahead at 192 kHz
+*/
+#define BLM_LINE 512
+
+/**
+* Samples of a block, that get their envelopes computed in one pass
+*/
+#define BLM_CHUNK 64
+
+/**
+* Vector of BF_LANES ints, used to mask the lanes of a bf_vec
+*/
+typedef int32_t bf_ivec
+    __attribute__((vector_size(BF_LANES * sizeof(int32_t))));
+
+/**
+* Limiter struct
+*/
+typedef struct blimiter {
+    double  rate;               ///< sample rate
+    float   attack;             ///< envelope coefficient, rising
+    float   attack_free;        ///< rising coefficient without lookahead
+    float   release;            ///< envelope coefficient, falling
+    uint32_t channels;          ///< number of channels
+    bool    linked;             ///< one envelope for all channels
+    uint32_t la;                ///< lookahead in samples
+    uint32_t la_pos;            ///< write position of the lookahead lines
+    float   env[BF_CHANNELS];   ///< envelope of each channel
+    float   gain[BF_CHANNELS][BLM_CHUNK];           ///< block scratch
+    float   line[BF_CHANNELS][BLM_LINE];            ///< lookahead lines
+} BollieLimiter;
+
+void blm_init(BollieLimiter* lim, double rate, uint32_t channels,
+    float attack_ms, float release_ms);
+void blm_set(BollieLimiter* lim, bool linked, float lookahead_ms);
+void blm_reset(BollieLimiter* lim);
+void blm_flush(BollieLimiter* lim);
+void blm_process_block(BollieLimiter* lim, float* const* x, uint32_t n);
+
+
+/**
+* Reciprocal of a vector, three Newton steps from a bit level estimate. Good
+* to about one ulp for the envelope values it gets, which are above one.
+* \param e values, positive and normal
+* \return 1 / e
+*/
+static inline bf_vec blm_rcp(bf_vec e) {
+    const bf_ivec magic = (bf_ivec){0} + 0x7ef311c3;
+    const bf_vec two = (bf_vec){0} + 2.f;
+    bf_vec r = (bf_vec)(magic - (bf_ivec)e);
+    r = r * (two - e * r);
+    r = r * (two - e * r);
+    r = r * (two - e * r);
+    return r;
+}
+
+
+/**
+* Applies the gain of a vector of envelopes. Lanes at or below unity pass
+* unchanged.
+* \param x samples
+* \param env envelopes
+* \return limited samples
+*/
+static inline bf_vec blm_apply(bf_vec x, bf_vec env) {
+    const bf_vec one = (bf_vec){0} + 1.f;
+    bf_ivec over = env > one;
+    bf_vec y = x * blm_rcp(env);
+    return (bf_vec)((over & (bf_ivec)y) | (~over & (bf_ivec)x));
+}
+
+
+/**
+* Steps a vector of envelopes, attack or release picked by mask.
+* \param lim pointer to the limiter
+* \param env envelopes
+* \param v rectified samples
+* \return new envelopes
+*/
+static inline bf_vec blm_follow(const BollieLimiter* lim, bf_vec env,
+    bf_vec v) {
+    const bf_vec zero = {0};
+    bf_ivec up = v > env;
+    bf_vec coeff = (bf_vec)((up & (bf_ivec)(zero + lim->attack))
+        | (~up & (bf_ivec)(zero + lim->release)));
+    return coeff * (env - v) + v;
+}
+
+
+/**
+* Limits one frame of the per sample path in place.
+* \param lim pointer to the limiter
+* \param x samples of all channels, padded with zeros to BF_CHANNELS
+*/
+static inline void blm_process_frame(BollieLimiter* lim, float* x) {
+    const bf_ivec abs_mask = (bf_ivec){0} + 0x7fffffff;
+    const uint32_t groups = (lim->channels + BF_LANES - 1) / BF_LANES;
+    bf_vec s[BF_GROUPS], v[BF_GROUPS], env[BF_GROUPS];
+    for (uint32_t g = 0 ; g < groups ; ++g) {
+        memcpy(&s[g], x + g * BF_LANES, sizeof(bf_vec));
+        memcpy(&env[g], lim->env + g * BF_LANES, sizeof(bf_vec));
+        v[g] = (bf_vec)((bf_ivec)s[g] & abs_mask);
+    }
+
+    if (lim->linked) {
+        // All lanes follow the loudest channel
+        float peak = 0;
+        for (uint32_t g = 0 ; g < groups ; ++g) {
+            for (uint32_t l = 0 ; l < BF_LANES ; ++l)
+                peak = v[g][l] > peak ? v[g][l] : peak;
+        }
+        for (uint32_t g = 0 ; g < groups ; ++g)
+            v[g] = (bf_vec){0} + peak;
+    }
+
+    for (uint32_t g = 0 ; g < groups ; ++g) {
+        env[g] = blm_follow(lim, env[g], v[g]);
+        memcpy(lim->env + g * BF_LANES, &env[g], sizeof(bf_vec));
+    }
+
+    // The signal comes out of the lookahead lines, behind its envelope
+    if (lim->la) {
+        const uint32_t w = lim->la_pos;
+        const uint32_t r = (w - lim->la) & (BLM_LINE - 1);
+        for (uint32_t g = 0 ; g < groups ; ++g) {
+            for (uint32_t l = 0 ; l < BF_LANES ; ++l) {
+                float* line = lim->line[g * BF_LANES + l];
+                line[w] = s[g][l];
+                s[g][l] = line[r];
+            }
+        }
+        lim->la_pos = (w + 1) & (BLM_LINE - 1);
+    }
+
+    for (uint32_t g = 0 ; g < groups ; ++g) {
+        s[g] = blm_apply(s[g], env[g]);
+        memcpy(x + g * BF_LANES, &s[g], sizeof(bf_vec));
+    }
+}
+
+#endif
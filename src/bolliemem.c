@@ -0,0 +1,131 @@
+/**
+    Bollie Delay XT - (c) 2017 Thomas Ebeling https://ca9.eu
+
+    This file is part of bolliedelayxt.lv2
+
+    bolliedelay.lv2 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    bolliedelay.lv2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+* \file bolliemem.c
+* \author Bollie (https://ca9.eu)
+* \brief Allocation of large, zeroed memory blocks.
+*/
+
+#include "bolliemem.h"
+#include <stdint.h>
+
+#if defined(_WIN32)
+#include <stdlib.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+/**
+* Allocates a zeroed block of memory. Pages are committed on first access.
+* Not real time safe.
+* \param size   Size of the block in bytes
+* \return       Pointer to the block or NULL
+*/
+void* bm_alloc(size_t size) {
+#if defined(_WIN32)
+    return calloc(1, size);
+#else
+    void* p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+#endif
+}
+
+
+/**
+* Frees a block allocated with bm_alloc().
+* \param p      Pointer to the block, may be NULL
+* \param size   Size of the block in bytes, as passed to bm_alloc()
+*/
+void bm_free(void* p, size_t size) {
+    if (!p)
+        return;
+#if defined(_WIN32)
+    free(p);
+#else
+    munmap(p, size);
+#endif
+}
+
+
+/**
+* Commits all pages of a block up front, so the audio thread doesn't take
+* the page faults. Reading isn't enough, that maps the shared zero page.
+* Not real time safe.
+* \param p      Pointer to the block
+* \param size   Size of the block in bytes
+*/
+void bm_prefault(void* p, size_t size) {
+#if !defined(_WIN32)
+    size_t page = sysconf(_SC_PAGESIZE);
+    volatile char* c = (volatile char*)p;
+    for (size_t i = 0 ; i < size ; i += page)
+        c[i] = 0;
+#endif
+}
+
+
+/**
+* Commits the pages of a range without changing its contents, so other
+* threads may keep writing to it meanwhile. Not real time safe.
+* \param p      Start of the range
+* \param size   Size of the range in bytes
+*/
+void bm_commit(void* p, size_t size) {
+#if !defined(_WIN32)
+    size_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)p & ~(uintptr_t)(page - 1);
+    uintptr_t end = (uintptr_t)p + size;
+#if defined(MADV_POPULATE_WRITE)
+    // Linux 5.14 and up, older kernels fail and take the loop below
+    if (!madvise((void*)start, end - start, MADV_POPULATE_WRITE))
+        return;
+#endif
+    // Adding zero writes to the page, but keeps what's there
+    for (uintptr_t a = (uintptr_t)p ; a < end ; a = (a & ~(page - 1)) + page)
+        __atomic_fetch_add((char*)a, 0, __ATOMIC_RELAXED);
+#endif
+}
+
+
+/**
+* Returns the pages of a block from a given offset on to the system. They
+* read as zero afterwards and are committed again on the next write. Only
+* Linux guarantees that, elsewhere the block is left as it is. Not real
+* time safe.
+* \param p      Pointer to the block
+* \param from   First byte to return, rounded up to the next page
+* \param size   Size of the block in bytes, as passed to bm_alloc()
+* \return       0 on success, -1 if the pages have been left as they are
+*/
+int bm_trim(void* p, size_t from, size_t size) {
+#if defined(__linux__)
+    // Mappings end on a page boundary
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t start = (from + page - 1) & ~(page - 1);
+    size_t end = (size + page - 1) & ~(page - 1);
+    if (start >= end)
+        return 0;
+    return madvise((char*)p + start, end - start, MADV_DONTNEED) ? -1 : 0;
+#else
+    return -1;
+#endif
+}
@@ -0,0 +1,41 @@
+/**
+    Bollie Delay XT - (c) 2017 Thomas Ebeling https://ca9.eu
+
+    This file is part of bolliedelayxt.lv2
+
+    bolliedelay.lv2 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    bolliedelay.lv2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+* \file bolliemem.h
+* \author Bollie (https://ca9.eu)
+* \brief Allocation of large, zeroed memory blocks.
+*
+* Blocks are mapped from the system as lazily committed zero pages, so
+* allocating them costs next to nothing and pages, that are never touched,
+* never take up physical memory.
+*/
+
+#ifndef __BOLLIEMEM_H__
+#define __BOLLIEMEM_H__
+
+#include <stddef.h>
+
+void* bm_alloc(size_t size);
+void bm_free(void* p, size_t size);
+void bm_prefault(void* p, size_t size);
+void bm_commit(void* p, size_t size);
+int bm_trim(void* p, size_t from, size_t size);
+
+#endif
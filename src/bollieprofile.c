@@ -0,0 +1,85 @@
+/**
+    Bollie Delay XT - (c) 2017 Thomas Ebeling https://ca9.eu
+
+    This file is part of bolliedelayxt.lv2
+
+    bolliedelay.lv2 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    bolliedelay.lv2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+* \file bollieprofile.c
+* \author Bollie (https://ca9.eu)
+* \brief Timing of the processing stages, for the load output ports.
+*/
+
+#include <math.h>
+#include "bollieprofile.h"
+
+
+/**
+* Initializes a profile, switched off.
+* \param p pointer to the profile
+* \param rate sample rate
+*/
+void bpr_init(BollieProfile* p, double rate) {
+    p->rate = rate;
+    p->window = BPR_WINDOW_S * rate;
+    p->on = false;
+    bpr_reset(p);
+}
+
+
+/**
+* Sets all values back to zero.
+* \param p pointer to the profile
+*/
+void bpr_reset(BollieProfile* p) {
+    for (int i = 0 ; i < BPR_VALUES ; ++i) {
+        p->acc[i] = 0;
+        p->avg[i] = p->max[i] = p->held[i] = 0;
+    }
+    p->window_pos = 0;
+}
+
+
+/**
+* Ends a run and takes its times into the averages and maxima.
+* \param p pointer to the profile
+* \param n number of samples of the run
+*/
+void bpr_end(BollieProfile* p, uint32_t n) {
+    if (!BPR_BUILT || !p->on || !n)
+        return;
+
+    p->acc[BPR_LOAD] = bpr_now() - p->start;
+
+    // ns to % of the time, the samples of this run last
+    const float scale = 1e-7 * p->rate / n;
+    const float k = 1. - exp(-(double)n / p->window);
+    for (int i = 0 ; i < BPR_VALUES ; ++i) {
+        float v = p->acc[i] * scale;
+        p->avg[i] += (v - p->avg[i]) * k;
+        if (v > p->max[i])
+            p->max[i] = v;
+    }
+
+    p->window_pos += n;
+    if (p->window_pos >= p->window) {
+        for (int i = 0 ; i < BPR_VALUES ; ++i) {
+            p->held[i] = p->max[i];
+            p->max[i] = 0;
+        }
+        p->window_pos = 0;
+    }
+}
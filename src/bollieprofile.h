@@ -0,0 +1,155 @@
+/**
+    Bollie Delay XT - (c) 2017 Thomas Ebeling https://ca9.eu
+
+    This file is part of bolliedelayxt.lv2
+
+    bolliedelay.lv2 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    bolliedelay.lv2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+* \file bollieprofile.h
+* \author Bollie (https://ca9.eu)
+* \brief Timing of the processing stages, for the load output ports.
+*
+* The time spent in each stage of a run is put in relation to the duration
+* of the samples processed, so all values are in % of the realtime budget.
+* Averages follow with a time constant of BPR_WINDOW_S, maxima are held
+* for at least as long. Only built with BOLLIE_PROFILE defined, otherwise
+* all of this compiles to nothing.
+*/
+
+#ifndef __BOLLIEPROFILE_H__
+#define __BOLLIEPROFILE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#ifdef BOLLIE_PROFILE
+#define BPR_BUILT 1
+#else
+#define BPR_BUILT 0
+#endif
+
+/**
+* Time constant of the averages and hold time of the maxima in seconds
+*/
+#define BPR_WINDOW_S 1.0
+
+/**
+* Measured values, the stages of the block path and the whole run
+*/
+typedef enum {
+    BPR_SMOOTH,                 ///< parameter smoothing and LFO
+    BPR_READS,                  ///< delay line and tap reads
+    BPR_LIMITER,                ///< feedback limiter
+    BPR_FB_FILTERS,             ///< feedback filters
+    BPR_PRE_FILTERS,            ///< pre filters
+    BPR_MIX,                    ///< summing, delay line writes and outputs
+    BPR_LOAD,                   ///< all of run()
+    BPR_VALUES
+} BollieStage;
+
+/**
+* Profile struct
+*/
+typedef struct bprofile {
+    double  rate;               ///< sample rate
+    bool    on;                 ///< measuring the current run
+    uint64_t start;             ///< start of the current run in ns
+    uint64_t last;              ///< end of the last stage in ns
+    uint64_t acc[BPR_VALUES];   ///< ns spent in each stage of this run
+    uint32_t window;            ///< samples a maximum is held for
+    uint32_t window_pos;        ///< samples into the current window
+    float   avg[BPR_VALUES];    ///< rolling averages
+    float   max[BPR_VALUES];    ///< maxima of the current window
+    float   held[BPR_VALUES];   ///< maxima of the last window
+} BollieProfile;
+
+void bpr_init(BollieProfile* p, double rate);
+void bpr_reset(BollieProfile* p);
+void bpr_end(BollieProfile* p, uint32_t n);
+
+
+/**
+* Returns a monotonic time stamp.
+* \return time in ns
+*/
+static inline uint64_t bpr_now() {
+#if BPR_BUILT
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#else
+    return 0;
+#endif
+}
+
+
+/**
+* Starts measuring a run, if switched on. Switching starts over with all
+* values at zero.
+* \param p pointer to the profile
+* \param on measuring is switched on
+*/
+static inline void bpr_begin(BollieProfile* p, bool on) {
+    if (!BPR_BUILT)
+        return;
+    if (on != p->on) {
+        bpr_reset(p);
+        p->on = on;
+    }
+    if (on) {
+        for (int i = 0 ; i < BPR_VALUES ; ++i)
+            p->acc[i] = 0;
+        p->start = p->last = bpr_now();
+    }
+}
+
+
+/**
+* Marks the start of the staged part of a block.
+* \param p pointer to the profile
+*/
+static inline void bpr_start(BollieProfile* p) {
+    if (BPR_BUILT && p->on)
+        p->last = bpr_now();
+}
+
+
+/**
+* Marks the end of a stage, that started with the last mark.
+* \param p pointer to the profile
+* \param stage stage that ends
+*/
+static inline void bpr_mark(BollieProfile* p, BollieStage stage) {
+    if (BPR_BUILT && p->on) {
+        uint64_t t = bpr_now();
+        p->acc[stage] += t - p->last;
+        p->last = t;
+    }
+}
+
+
+/**
+* Returns the maximum of a value, over the current and the last window.
+* \param p pointer to the profile
+* \param v value
+* \return maximum in % of the realtime budget
+*/
+static inline float bpr_max(const BollieProfile* p, BollieStage v) {
+    return p->max[v] > p->held[v] ? p->max[v] : p->held[v];
+}
+
+#endif
@@ -0,0 +1,163 @@
+/**
+    Bollie Delay XT - (c) 2017 Thomas Ebeling https://ca9.eu
+
+    This file is part of bolliedelayxt.lv2
+
+    bolliedelay.lv2 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    bolliedelay.lv2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+* \file bolliesmooth.c
+* \author Bollie (https://ca9.eu)
+* \brief Parameter smoothing at control rate.
+*/
+
+#include <math.h>
+#include "bolliesmooth.h"
+
+
+/**
+* Initializes a smoother, settled at a value.
+* \param s pointer to the smoother
+* \param rate sample rate
+* \param ms time constant in ms, the distance to the target falls to 1/e
+*        within it
+* \param eps distance to the target, at which the value snaps to it
+* \param v initial value
+*/
+void bsm_init(BollieSmooth* s, double rate, float ms, float eps, float v) {
+    double samples = ms * 0.001 * rate;
+    for (int i = 0 ; i < BSM_SUB ; ++i)
+        s->decay[i] = exp(-(i + 1) / samples);
+    s->eps = eps;
+    bsm_reset(s, v);
+}
+
+
+/**
+* Jumps to a value and settles there.
+* \param s pointer to the smoother
+* \param v value
+*/
+void bsm_reset(BollieSmooth* s, float v) {
+    s->cur = s->tgt = v;
+    s->settled = true;
+    s->flat = false;
+}
+
+
+/**
+* Continues from a value, for a block that has been cut short after its
+* ramp has been taken.
+* \param s pointer to the smoother
+* \param v value reached
+*/
+void bsm_hold(BollieSmooth* s, float v) {
+    if (v != s->cur) {
+        s->cur = v;
+        s->settled = v == s->tgt;
+        s->flat = false;
+    }
+}
+
+
+/**
+* Returns the factor the distance to the target shrinks by over a number of
+* samples.
+* \param s pointer to the smoother
+* \param n number of samples
+* \return decay factor
+*/
+float bsm_coeff(const BollieSmooth* s, uint32_t n) {
+    float d = 1.f;
+    for ( ; n >= BSM_SUB ; n -= BSM_SUB)
+        d *= s->decay[BSM_SUB - 1];
+    return n ? d * s->decay[n - 1] : d;
+}
+
+
+/**
+* Snaps to the target once within reach, or once the steps towards it got
+* too small to change the value. Float precision would keep it short of the
+* target forever otherwise.
+* \param s pointer to the smoother
+* \param prev value before the last step
+*/
+static void settle(BollieSmooth* s, float prev) {
+    if (fabsf(s->cur - s->tgt) <= s->eps || s->cur == prev) {
+        s->cur = s->tgt;
+        s->settled = true;
+    }
+}
+
+
+/**
+* Advances a smoother without producing its ramp, for blocks that don't
+* need the values.
+* \param s pointer to the smoother
+* \param n number of samples
+*/
+void bsm_skip(BollieSmooth* s, uint32_t n) {
+    if (s->settled)
+        return;
+    float prev = s->cur;
+    s->cur = s->tgt + (s->cur - s->tgt) * bsm_coeff(s, n);
+    settle(s, prev);
+}
+
+
+/**
+* Advances a smoother by a block and returns its values. The curve is
+* evaluated at the end of each step of BSM_SUB samples and ramped linearly
+* towards it. A settled smoother only fills its ramp once.
+* \param s pointer to the smoother
+* \param n number of samples, not more than BSM_BLOCK
+* \return values of each sample of the block
+*/
+const float* bsm_block(BollieSmooth* s, uint32_t n) {
+    float *r = s->ramp;
+
+    if (s->flat)
+        return r;
+    if (s->settled) {
+        for (uint32_t i = 0 ; i < BSM_BLOCK ; ++i)
+            r[i] = s->tgt;
+        s->flat = true;
+        return r;
+    }
+
+    const float tgt = s->tgt;
+    const float prev = s->cur;
+    float cur = prev;
+    uint32_t i = 0;
+    for ( ; i + BSM_SUB <= n ; i += BSM_SUB) {
+        float end = tgt + (cur - tgt) * s->decay[BSM_SUB - 1];
+        float step = (end - cur) * (1.f / BSM_SUB);
+        for (uint32_t k = 0 ; k < BSM_SUB ; ++k)
+            r[i + k] = cur + step * (k + 1);
+        cur = end;
+    }
+    if (i < n) {
+        uint32_t m = n - i;
+        float end = tgt + (cur - tgt) * s->decay[m - 1];
+        float step = (end - cur) / m;
+        for (uint32_t k = 0 ; k < m ; ++k)
+            r[i + k] = cur + step * (k + 1);
+        cur = end;
+    }
+
+    s->cur = cur;
+    settle(s, prev);
+    return r;
+}
@@ -0,0 +1,81 @@
+/**
+    Bollie Delay XT - (c) 2017 Thomas Ebeling https://ca9.eu
+
+    This file is part of bolliedelayxt.lv2
+
+    bolliedelay.lv2 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    bolliedelay.lv2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+* \file bolliesmooth.h
+* \author Bollie (https://ca9.eu)
+* \brief Parameter smoothing at control rate.
+*
+* A smoother glides exponentially towards its target, with a time constant
+* in ms. The curve is evaluated once per BSM_SUB samples and ramped
+* linearly in between. Once the value is within reach of its target, it
+* snaps to it and the smoother is settled: its ramp stays flat and costs
+* nothing until the target changes again.
+*/
+
+#ifndef __BOLLIESMOOTH_H__
+#define __BOLLIESMOOTH_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+* Samples per control rate step
+*/
+#define BSM_SUB 16
+
+/**
+* Longest block a smoother ramps at once
+*/
+#define BSM_BLOCK 256
+
+/**
+* Smoother struct
+*/
+typedef struct bsmooth {
+    float   cur;                ///< value at the end of the last block
+    float   tgt;                ///< target value
+    float   eps;                ///< distance to the target, that settles
+    float   decay[BSM_SUB];     ///< decay of the distance after i+1 samples
+    bool    settled;            ///< cur has reached tgt
+    bool    flat;               ///< the ramp holds tgt all along
+    float   ramp[BSM_BLOCK];    ///< values of the last block
+} BollieSmooth;
+
+void bsm_init(BollieSmooth* s, double rate, float ms, float eps, float v);
+void bsm_reset(BollieSmooth* s, float v);
+void bsm_hold(BollieSmooth* s, float v);
+void bsm_skip(BollieSmooth* s, uint32_t n);
+const float* bsm_block(BollieSmooth* s, uint32_t n);
+float bsm_coeff(const BollieSmooth* s, uint32_t n);
+
+
+/**
+* Sets a new target. Nothing happens, if it's the current one.
+* \param s pointer to the smoother
+* \param tgt target value
+*/
+static inline void bsm_set(BollieSmooth* s, float tgt) {
+    if (tgt != s->tgt) {
+        s->tgt = tgt;
+        s->settled = s->flat = false;
+    }
+}
+
+#endif
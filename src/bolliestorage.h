@@ -0,0 +1,152 @@
+/**
+    Bollie Delay XT - (c) 2017 Thomas Ebeling https://ca9.eu
+
+    This file is part of bolliedelayxt.lv2
+
+    bolliedelay.lv2 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    bolliedelay.lv2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+* \file bolliestorage.h
+* \author Bollie (https://ca9.eu)
+* \brief Sample format of the delay lines.
+*
+* The delay lines hold 32 bit floats by default. Building with
+* BOLLIE_STORAGE_HALF stores IEEE half floats, BOLLIE_STORAGE_INT16 16 bit
+* fixed point with BS_INT16_RANGE of headroom. Both halve the footprint and
+* the memory traffic of the delay lines. Processing stays in float, samples
+* are converted on write and on read.
+*
+* Every format provides
+* - bs_load(), bs_store(): converts a single sample
+* - bs_load4(): converts 4 consecutive samples, the taps of a 4 point kernel
+* - bs_store_block(): converts a block of samples
+*/
+
+#ifndef __BOLLIESTORAGE_H__
+#define __BOLLIESTORAGE_H__
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(BOLLIE_STORAGE_HALF)
+
+#if defined(__F16C__)
+#include <immintrin.h>
+typedef uint16_t bs_sample;
+
+static inline float bs_load(bs_sample v) {
+    return _cvtsh_ss(v);
+}
+
+static inline bs_sample bs_store(float v) {
+    return _cvtss_sh(v, _MM_FROUND_TO_NEAREST_INT);
+}
+
+static inline void bs_load4(const bs_sample* s, float* v) {
+    _mm_storeu_ps(v, _mm_cvtph_ps(_mm_loadl_epi64((const __m128i*)s)));
+}
+
+static inline void bs_store_block(bs_sample* dst, const float* src,
+    uint32_t n) {
+    uint32_t i = 0;
+    for ( ; i + 4 <= n ; i += 4)
+        _mm_storel_epi64((__m128i*)(dst + i),
+            _mm_cvtps_ph(_mm_loadu_ps(src + i), _MM_FROUND_TO_NEAREST_INT));
+    for ( ; i < n ; ++i)
+        dst[i] = bs_store(src[i]);
+}
+
+#elif defined(__aarch64__) || defined(__ARM_FP16_FORMAT_IEEE)
+// Native conversions, the compiler vectorizes the loops
+typedef __fp16 bs_sample;
+
+static inline float bs_load(bs_sample v) {
+    return v;
+}
+
+static inline bs_sample bs_store(float v) {
+    return v;
+}
+
+static inline void bs_load4(const bs_sample* s, float* v) {
+    for (int i = 0 ; i < 4 ; ++i)
+        v[i] = s[i];
+}
+
+static inline void bs_store_block(bs_sample* dst, const float* src,
+    uint32_t n) {
+    for (uint32_t i = 0 ; i < n ; ++i)
+        dst[i] = src[i];
+}
+
+#else
+#error "Half float storage needs F16C (x86) or IEEE __fp16 (ARM)"
+#endif
+
+#elif defined(BOLLIE_STORAGE_INT16)
+
+/**
+* Largest magnitude a 16 bit sample can hold. Louder samples are clipped,
+* the limiter on the read side keeps the feedback path well below that.
+*/
+#define BS_INT16_RANGE 4.f
+
+typedef int16_t bs_sample;
+
+static inline float bs_load(bs_sample v) {
+    return v * (BS_INT16_RANGE / 32768.f);
+}
+
+static inline bs_sample bs_store(float v) {
+    v = fminf(fmaxf(v * (32768.f / BS_INT16_RANGE), -32767.f), 32767.f);
+    return (bs_sample)lrintf(v);
+}
+
+static inline void bs_load4(const bs_sample* s, float* v) {
+    for (int i = 0 ; i < 4 ; ++i)
+        v[i] = bs_load(s[i]);
+}
+
+static inline void bs_store_block(bs_sample* dst, const float* src,
+    uint32_t n) {
+    for (uint32_t i = 0 ; i < n ; ++i)
+        dst[i] = bs_store(src[i]);
+}
+
+#else
+
+typedef float bs_sample;
+
+static inline float bs_load(bs_sample v) {
+    return v;
+}
+
+static inline bs_sample bs_store(float v) {
+    return v;
+}
+
+static inline void bs_load4(const bs_sample* s, float* v) {
+    memcpy(v, s, 4 * sizeof(float));
+}
+
+static inline void bs_store_block(bs_sample* dst, const float* src,
+    uint32_t n) {
+    memcpy(dst, src, n * sizeof(float));
+}
+
+#endif
+
+#endif
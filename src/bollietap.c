@@ -0,0 +1,416 @@
+/**
+    Bollie Delay XT - (c) 2017 Thomas Ebeling https://ca9.eu
+
+    This file is part of bolliedelayxt.lv2
+
+    bolliedelay.lv2 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    bolliedelay.lv2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+* \file bollietap.c
+* \author Bollie (https://ca9.eu)
+* \brief Additional read heads on a delay line, panned into the stereo mix.
+*/
+
+#include "bollietap.h"
+#include <math.h>
+#include <string.h>
+#include "bolliedenormal.h"
+
+#define BT_GROUPS (BT_TAPS / BT_LANES)
+#define BT_QUIET 1e-6f          ///< smoothers below this have faded out
+
+/**
+* Active taps of a bank, packed into groups of lanes for the block kernels.
+* Each value is smoothed from tgt + diff towards tgt.
+*/
+typedef struct {
+    bt_vec  tgt_d;
+    bt_vec  diff_d;
+    bt_vec  tgt_gain_l;
+    bt_vec  diff_gain_l;
+    bt_vec  tgt_gain_r;
+    bt_vec  diff_gain_r;
+    bt_vec  tgt_fb;
+    bt_vec  diff_fb;
+    bt_vec  ap_x1;
+    bt_vec  ap_y1;
+} BollieTapGroup;
+
+
+/**
+* Initializes a tap bank with all taps silent
+* \param bt     Pointer to the BollieTaps object
+*/
+void bt_init(BollieTaps* bt) {
+    memset(bt, 0, sizeof(BollieTaps));
+}
+
+
+/**
+* Sets the targets of a tap. A silent tap jumps to its delay time right
+* away, there's nothing to glide.
+* \param bt     Pointer to the BollieTaps object
+* \param tap    index of the tap
+* \param d      delay time in samples
+* \param gain_l gain towards the first output
+* \param gain_r gain towards the second output
+* \param fb     feedback gain into the own delay line
+*/
+void bt_set(BollieTaps* bt, int tap, float d, float gain_l, float gain_r,
+    float fb) {
+    uint32_t bit = 1u << tap;
+    if (!(bt->active & bit))
+        bt->cur_d[tap] = d;
+    bt->tgt_d[tap] = d;
+    bt->tgt_gain_l[tap] = gain_l;
+    bt->tgt_gain_r[tap] = gain_r;
+    bt->tgt_fb[tap] = fb;
+    if (gain_l > 0 || gain_r > 0 || fb > 0)
+        bt->active |= bit;
+}
+
+
+/**
+* Returns the longest delay time of the active taps, current or target.
+* \param bt     Pointer to the BollieTaps object
+* \return       delay time in samples, 0 without active taps
+*/
+float bt_longest(const BollieTaps* bt) {
+    float d = 0;
+    for (uint32_t a = bt->active ; a ; a &= a - 1) {
+        int t = __builtin_ctz(a);
+        d = fmaxf(d, fmaxf(bt->cur_d[t], bt->tgt_d[t]));
+    }
+    return d;
+}
+
+
+/**
+* Returns the shortest delay time of the active taps, current or target.
+* \param bt     Pointer to the BollieTaps object
+* \return       delay time in samples, infinity without active taps
+*/
+float bt_shortest(const BollieTaps* bt) {
+    float d = INFINITY;
+    for (uint32_t a = bt->active ; a ; a &= a - 1) {
+        int t = __builtin_ctz(a);
+        d = fminf(d, fminf(bt->cur_d[t], bt->tgt_d[t]));
+    }
+    return d;
+}
+
+
+/**
+* Returns an upper bound of the gain the taps feed back into the line.
+* \param bt     Pointer to the BollieTaps object
+* \return       sum of the feedback gains, current or target
+*/
+float bt_loop_gain(const BollieTaps* bt) {
+    float g = 0;
+    for (uint32_t a = bt->active ; a ; a &= a - 1) {
+        int t = __builtin_ctz(a);
+        g += fmaxf(bt->cur_fb[t], bt->tgt_fb[t]);
+    }
+    return g;
+}
+
+
+/**
+* Advances the smoothers of the active taps without reading anything, for
+* blocks, where the delay line holds nothing but zeros.
+* \param bt     Pointer to the BollieTaps object
+* \param pf     fast smoothing coefficient to the power of the block length
+* \param ps     slow smoothing coefficient to the power of the block length
+*/
+void bt_skip(BollieTaps* bt, float pf, float ps) {
+    for (uint32_t a = bt->active ; a ; a &= a - 1) {
+        int t = __builtin_ctz(a);
+        bt->cur_d[t] = bt->tgt_d[t] + (bt->cur_d[t] - bt->tgt_d[t]) * ps;
+        bt->cur_gain_l[t] = bt->tgt_gain_l[t]
+            + (bt->cur_gain_l[t] - bt->tgt_gain_l[t]) * pf;
+        bt->cur_gain_r[t] = bt->tgt_gain_r[t]
+            + (bt->cur_gain_r[t] - bt->tgt_gain_r[t]) * pf;
+        bt->cur_fb[t] = bt->tgt_fb[t] + (bt->cur_fb[t] - bt->tgt_fb[t]) * pf;
+        bt->ap[t].x1 = bt->ap[t].y1 = 0;
+    }
+}
+
+
+/**
+* Flushes decayed states to zero and retires taps, that have faded out.
+* \param bt     Pointer to the BollieTaps object
+*/
+void bt_flush(BollieTaps* bt) {
+    for (uint32_t a = bt->active ; a ; a &= a - 1) {
+        int t = __builtin_ctz(a);
+        bt->ap[t].x1 = bdn_flush(bt->ap[t].x1);
+        bt->ap[t].y1 = bdn_flush(bt->ap[t].y1);
+
+        if (bt->tgt_gain_l[t] > 0 || bt->tgt_gain_r[t] > 0
+            || bt->tgt_fb[t] > 0 || bt->cur_gain_l[t] >= BT_QUIET
+            || bt->cur_gain_r[t] >= BT_QUIET || bt->cur_fb[t] >= BT_QUIET)
+            continue;
+
+        bt->cur_gain_l[t] = bt->cur_gain_r[t] = bt->cur_fb[t] = 0;
+        bt->ap[t].x1 = bt->ap[t].y1 = 0;
+        bt->active &= ~(1u << t);
+    }
+}
+
+
+/**
+* Primes the allpass interpolators of the active taps.
+* \param bt     Pointer to the BollieTaps object
+* \param buf    pointer to the ring
+* \param size   size of the ring in samples, power of two
+* \param pos    write position
+*/
+void bt_allpass_prime(BollieTaps* bt, const bs_sample* buf, int32_t size,
+    int32_t pos) {
+    for (uint32_t a = bt->active ; a ; a &= a - 1) {
+        int t = __builtin_ctz(a);
+        bi_allpass_prime(&bt->ap[t], buf, size, (double)pos - bt->cur_d[t]);
+    }
+}
+
+
+/**
+* Processes one sample of all active taps, advancing their smoothers.
+* \param bt     Pointer to the BollieTaps object
+* \param q      interpolation kernel
+* \param buf    pointer to the ring
+* \param size   size of the ring in samples, power of two
+* \param x      sample coordinate of a tap without delay
+* \param pf     fast smoothing coefficient per sample
+* \param ps     slow smoothing coefficient per sample
+* \param out_l  sum of the taps towards the first output
+* \param out_r  sum of the taps towards the second output
+* \param fb     sum of the taps fed back into the line
+*/
+void bt_process(BollieTaps* bt, BollieInterp q, const bs_sample* buf,
+    int32_t size, double x, float pf, float ps, float* out_l, float* out_r,
+    float* fb) {
+    float l = 0, r = 0, f = 0;
+    for (uint32_t a = bt->active ; a ; a &= a - 1) {
+        int t = __builtin_ctz(a);
+        bt->cur_d[t] = bt->tgt_d[t] + (bt->cur_d[t] - bt->tgt_d[t]) * ps;
+        bt->cur_gain_l[t] = bt->tgt_gain_l[t]
+            + (bt->cur_gain_l[t] - bt->tgt_gain_l[t]) * pf;
+        bt->cur_gain_r[t] = bt->tgt_gain_r[t]
+            + (bt->cur_gain_r[t] - bt->tgt_gain_r[t]) * pf;
+        bt->cur_fb[t] = bt->tgt_fb[t] + (bt->cur_fb[t] - bt->tgt_fb[t]) * pf;
+
+        float s = bi_read(q, buf, size, x - bt->cur_d[t], &bt->ap[t]);
+        l += bt->cur_gain_l[t] * s;
+        r += bt->cur_gain_r[t] * s;
+        f += bt->cur_fb[t] * s;
+    }
+    *out_l = l;
+    *out_r = r;
+    *fb = f;
+}
+
+
+/**
+* Reads one sample for each lane of a group of taps. The samples around the
+* read positions are gathered lane by lane, the interpolation runs on all
+* lanes at once.
+* \param q      interpolation kernel
+* \param buf    pointer to the ring
+* \param size   size of the ring in samples, power of two
+* \param x      sample coordinate of a tap without delay
+* \param d      delay time of each lane in samples
+* \param ap_x1  last input of the allpass of each lane
+* \param ap_y1  last output of the allpass of each lane
+* \return       interpolated samples
+*/
+static inline __attribute__((always_inline)) bt_vec bt_read(BollieInterp q,
+    const bs_sample* buf, int32_t size, double x, bt_vec d, bt_vec* ap_x1,
+    bt_vec* ap_y1) {
+    const int32_t mask = size - 1;
+    const float (*tab)[4] = q == BI_LAGRANGE4 ? bi_lagrange4 : bi_hermite;
+    bt_vec c0 = {0}, c1 = {0}, c2 = {0}, c3 = {0}, c4 = {0}, c5 = {0};
+    bt_vec s0 = {0}, s1 = {0}, s2 = {0}, s3 = {0}, s4 = {0}, s5 = {0};
+    bt_vec y;
+
+    switch (q) {
+        case BI_HERMITE:
+        case BI_LAGRANGE4:
+            for (int l = 0 ; l < BT_LANES ; ++l) {
+                double xl = x - d[l] + size;
+                int32_t x0 = (int32_t)xl;
+                const float* c =
+                    tab[(int32_t)((xl - (double)x0) * BI_PHASES + 0.5)];
+                float v[4];
+                bs_load4(buf + ((x0 - 1) & mask), v);
+                c0[l] = c[0]; c1[l] = c[1]; c2[l] = c[2]; c3[l] = c[3];
+                s0[l] = v[0]; s1[l] = v[1]; s2[l] = v[2]; s3[l] = v[3];
+            }
+            return c0 * s0 + c1 * s1 + c2 * s2 + c3 * s3;
+        case BI_LAGRANGE6:
+            for (int l = 0 ; l < BT_LANES ; ++l) {
+                double xl = x - d[l] + size;
+                int32_t x0 = (int32_t)xl;
+                const float* c =
+                    bi_lagrange6[(int32_t)((xl - (double)x0) * BI_PHASES
+                    + 0.5)];
+                const bs_sample* s = buf + ((x0 - 2) & mask);
+                float v[4];
+                bs_load4(s, v);
+                c0[l] = c[0]; c1[l] = c[1]; c2[l] = c[2];
+                c3[l] = c[3]; c4[l] = c[4]; c5[l] = c[5];
+                s0[l] = v[0]; s1[l] = v[1]; s2[l] = v[2]; s3[l] = v[3];
+                s4[l] = bs_load(s[4]);
+                s5[l] = bs_load(s[5]);
+            }
+            return c0 * s0 + c1 * s1 + c2 * s2 + c3 * s3 + c4 * s4
+                + c5 * s5;
+        case BI_ALLPASS:
+            for (int l = 0 ; l < BT_LANES ; ++l) {
+                double xl = x - d[l] + size + 1.5;
+                int32_t r = (int32_t)xl;
+                c0[l] = bi_allpass[(int32_t)((xl - (double)r) * BI_PHASES
+                    + 0.5)];
+                s0[l] = bs_load(buf[r & mask]);
+            }
+            y = c0 * (s0 - *ap_y1) + *ap_x1;
+            *ap_x1 = s0;
+            *ap_y1 = y;
+            return y;
+        default:
+            for (int l = 0 ; l < BT_LANES ; ++l) {
+                double xl = x - d[l] + size;
+                int32_t x0 = (int32_t)xl;
+                c0[l] = xl - (double)x0;
+                x0 &= mask;
+                s0[l] = bs_load(buf[x0]);
+                s1[l] = bs_load(buf[x0 + 1]);
+            }
+            return s0 + c0 * (s1 - s0);
+    }
+}
+
+
+/**
+* Block kernel, inlined once per interpolation kernel.
+*/
+static inline __attribute__((always_inline)) void bt_kernel(BollieInterp q,
+    BollieTapGroup* g, int n_groups, const bs_sample* buf, int32_t size,
+    int32_t pos, const float* mod, const float* pw_fast,
+    const float* pw_slow, float* out_l, float* out_r, float* fb,
+    uint32_t n) {
+    for (uint32_t i = 0 ; i < n ; ++i) {
+        double x = (double)(pos + (int32_t)i) + mod[i];
+        float pf = pw_fast[i];
+        float ps = pw_slow[i];
+        bt_vec l = {0}, r = {0}, f = {0};
+        for (int k = 0 ; k < n_groups ; ++k) {
+            bt_vec s = bt_read(q, buf, size, x, g[k].tgt_d + g[k].diff_d * ps,
+                &g[k].ap_x1, &g[k].ap_y1);
+            l += (g[k].tgt_gain_l + g[k].diff_gain_l * pf) * s;
+            r += (g[k].tgt_gain_r + g[k].diff_gain_r * pf) * s;
+            f += (g[k].tgt_fb + g[k].diff_fb * pf) * s;
+        }
+        out_l[i] += l[0] + l[1] + l[2] + l[3];
+        out_r[i] += r[0] + r[1] + r[2] + r[3];
+        fb[i] += f[0] + f[1] + f[2] + f[3];
+    }
+}
+
+
+/**
+* Processes a block of all active taps. The smoothers are evaluated in
+* closed form like those of the main read heads. None of the reads may reach
+* into the block about to be written.
+* \param bt     Pointer to the BollieTaps object
+* \param q      interpolation kernel
+* \param buf    pointer to the ring
+* \param size   size of the ring in samples, power of two
+* \param pos    write position of the first sample, already wrapped
+* \param mod    modulation offset of each sample
+* \param pw_fast powers of the fast smoothing coefficient
+* \param pw_slow powers of the slow smoothing coefficient, for the delay
+* \param out_l  taps towards the first output are added here
+* \param out_r  taps towards the second output are added here
+* \param fb     taps fed back into the line are added here
+* \param n      number of samples
+*/
+void bt_process_block(BollieTaps* bt, BollieInterp q, const bs_sample* buf,
+    int32_t size, int32_t pos, const float* mod, const float* pw_fast,
+    const float* pw_slow, float* out_l, float* out_r, float* fb, uint32_t n) {
+    BollieTapGroup g[BT_GROUPS];
+    int idx[BT_TAPS];
+    int k = 0;
+
+    // Pack the active taps, spare lanes read silently at the write head
+    memset(g, 0, sizeof(g));
+    for (uint32_t a = bt->active ; a ; a &= a - 1) {
+        int t = __builtin_ctz(a);
+        BollieTapGroup* p = &g[k / BT_LANES];
+        int l = k % BT_LANES;
+        p->tgt_d[l] = bt->tgt_d[t];
+        p->diff_d[l] = bt->cur_d[t] - bt->tgt_d[t];
+        p->tgt_gain_l[l] = bt->tgt_gain_l[t];
+        p->diff_gain_l[l] = bt->cur_gain_l[t] - bt->tgt_gain_l[t];
+        p->tgt_gain_r[l] = bt->tgt_gain_r[t];
+        p->diff_gain_r[l] = bt->cur_gain_r[t] - bt->tgt_gain_r[t];
+        p->tgt_fb[l] = bt->tgt_fb[t];
+        p->diff_fb[l] = bt->cur_fb[t] - bt->tgt_fb[t];
+        p->ap_x1[l] = bt->ap[t].x1;
+        p->ap_y1[l] = bt->ap[t].y1;
+        idx[k++] = t;
+    }
+    if (!k)
+        return;
+
+    int n_groups = (k + BT_LANES - 1) / BT_LANES;
+    switch (q) {
+        case BI_HERMITE:
+            bt_kernel(BI_HERMITE, g, n_groups, buf, size, pos, mod,
+                pw_fast, pw_slow, out_l, out_r, fb, n);
+            break;
+        case BI_LAGRANGE4:
+            bt_kernel(BI_LAGRANGE4, g, n_groups, buf, size, pos, mod,
+                pw_fast, pw_slow, out_l, out_r, fb, n);
+            break;
+        case BI_LAGRANGE6:
+            bt_kernel(BI_LAGRANGE6, g, n_groups, buf, size, pos, mod,
+                pw_fast, pw_slow, out_l, out_r, fb, n);
+            break;
+        case BI_ALLPASS:
+            bt_kernel(BI_ALLPASS, g, n_groups, buf, size, pos, mod,
+                pw_fast, pw_slow, out_l, out_r, fb, n);
+            break;
+        default:
+            bt_kernel(BI_LINEAR, g, n_groups, buf, size, pos, mod,
+                pw_fast, pw_slow, out_l, out_r, fb, n);
+            break;
+    }
+
+    // Copy the smoothers and allpass states back
+    float pf = pw_fast[n-1];
+    float ps = pw_slow[n-1];
+    for (int j = 0 ; j < k ; ++j) {
+        const BollieTapGroup* p = &g[j / BT_LANES];
+        int l = j % BT_LANES;
+        int t = idx[j];
+        bt->cur_d[t] = p->tgt_d[l] + p->diff_d[l] * ps;
+        bt->cur_gain_l[t] = p->tgt_gain_l[l] + p->diff_gain_l[l] * pf;
+        bt->cur_gain_r[t] = p->tgt_gain_r[l] + p->diff_gain_r[l] * pf;
+        bt->cur_fb[t] = p->tgt_fb[l] + p->diff_fb[l] * pf;
+        bt->ap[t].x1 = p->ap_x1[l];
+        bt->ap[t].y1 = p->ap_y1[l];
+    }
+}
@@ -0,0 +1,85 @@
+/**
+    Bollie Delay XT - (c) 2017 Thomas Ebeling https://ca9.eu
+
+    This file is part of bolliedelayxt.lv2
+
+    bolliedelay.lv2 is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    bolliedelay.lv2 is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Foobar.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+* \file bollietap.h
+* \author Bollie (https://ca9.eu)
+* \brief Additional read heads on a delay line, panned into the stereo mix.
+*
+* A tap bank holds up to BT_TAPS read heads of one delay line. Each tap has
+* its own delay time, a gain towards either output and a feedback gain into
+* its own line. Only taps, that are audible or fading, are processed.
+*/
+
+#ifndef __BOLLIETAP_H__
+#define __BOLLIETAP_H__
+
+#include <stdint.h>
+#include "bollieinterp.h"
+#include "bolliestorage.h"
+
+/**
+* Number of taps of a bank
+*/
+#define BT_TAPS 8
+
+/**
+* Number of taps read at once by the block kernels
+*/
+#define BT_LANES 4
+
+/**
+* Vector of BT_LANES floats, one per tap
+*/
+typedef float bt_vec __attribute__((vector_size(BT_LANES * sizeof(float))));
+
+/**
+* Tap bank struct. Each value is smoothed towards its target.
+*/
+typedef struct btaps {
+    float   cur_d[BT_TAPS];     ///< delay time in samples
+    float   tgt_d[BT_TAPS];
+    float   cur_gain_l[BT_TAPS];///< gain towards the first output
+    float   tgt_gain_l[BT_TAPS];
+    float   cur_gain_r[BT_TAPS];///< gain towards the second output
+    float   tgt_gain_r[BT_TAPS];
+    float   cur_fb[BT_TAPS];    ///< feedback into the own delay line
+    float   tgt_fb[BT_TAPS];
+    BollieAllpass ap[BT_TAPS];  ///< allpass interpolator of each tap
+    uint32_t active;            ///< bit mask of taps audible or fading
+} BollieTaps;
+
+void bt_init(BollieTaps* bt);
+void bt_set(BollieTaps* bt, int tap, float d, float gain_l, float gain_r,
+    float fb);
+float bt_longest(const BollieTaps* bt);
+float bt_shortest(const BollieTaps* bt);
+float bt_loop_gain(const BollieTaps* bt);
+void bt_skip(BollieTaps* bt, float pf, float ps);
+void bt_flush(BollieTaps* bt);
+void bt_allpass_prime(BollieTaps* bt, const bs_sample* buf, int32_t size,
+    int32_t pos);
+void bt_process(BollieTaps* bt, BollieInterp q, const bs_sample* buf,
+    int32_t size, double x, float pf, float ps, float* out_l, float* out_r,
+    float* fb);
+void bt_process_block(BollieTaps* bt, BollieInterp q, const bs_sample* buf,
+    int32_t size, int32_t pos, const float* mod, const float* pw_fast,
+    const float* pw_slow, float* out_l, float* out_r, float* fb, uint32_t n);
+
+#endif